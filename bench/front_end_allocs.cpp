@@ -0,0 +1,88 @@
+// Heap allocations made by each front end phase on a source file: parsing,
+// traversing every function and checking them, with the peak RSS at the end.
+#include "checks.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "traverser.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <print>
+#include <sys/resource.h>
+#include <variant>
+
+static std::atomic<std::size_t> allocations{0};
+static std::atomic<std::size_t> allocated_bytes{0};
+
+void *operator new(std::size_t size) {
+    ++allocations;
+    allocated_bytes += size;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+// Memory resources ask for their blocks with an alignment
+void *operator new(std::size_t size, std::align_val_t align) {
+    ++allocations;
+    allocated_bytes += size;
+    auto alignment = static_cast<std::size_t>(align);
+    if (void *p = std::aligned_alloc(alignment, (size + alignment - 1) /
+                                                    alignment * alignment)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+struct Phase {
+    std::size_t count{allocations};
+    std::size_t bytes{allocated_bytes};
+    std::chrono::steady_clock::time_point start{
+        std::chrono::steady_clock::now()};
+
+    void report(char const *name) const {
+        std::chrono::duration<double> took =
+            std::chrono::steady_clock::now() - start;
+        std::println("{:<9} {:>10} allocations {:>12} bytes {:>9.2f} ms", name,
+                      allocations - count, allocated_bytes - bytes,
+                      took.count() * 1e3);
+    }
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::println("usage: {} <source>", argv[0]);
+        return 1;
+    }
+    auto src = source::Source::map(argv[1]);
+
+    Phase parsing{};
+    auto decls = parser::parse_source(src.view());
+    parsing.report("parse");
+
+    Phase traversal{};
+    std::vector<traverser::Function> fns{};
+    for (auto const &decl : decls) {
+        auto const &fn = std::get<parser::FnDecl>(decl);
+        fns.emplace_back(traverser::Function{fn.name, fn.args, fn.rets,
+                                             traverser::traverse(fn.body)});
+    }
+    traversal.report("traverse");
+
+    Phase checking{};
+    auto facts = checks::TypeChecker(std::move(fns)).check();
+    checking.report("check");
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    std::println("peak rss  {} KiB", usage.ru_maxrss);
+}
@@ -0,0 +1,75 @@
+// Lexer throughput on a large grid program, either a given source file or a
+// generated one mixing the token kinds found in real programs.
+#include "parser.hpp"
+#include "source.hpp"
+#include "utf.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <print>
+#include <string>
+
+std::string generate(std::size_t fns) {
+    std::string src{};
+    for (std::size_t i = 0; i < fns; ++i) {
+        src += std::format("fn step-{} (x : int s : string) -> (int) {{\n", i);
+        src += "→ ⇈ 10 < ? ◌ \"big\" print 1.5 ◌ -> 'c' ◌ ↓\n";
+        src += "  ↓         ↓\n";
+        src += "  → 1 + swp ◌ ↓\n";
+        src += "            ← ↓ <- x\n";
+        src += "}\n\n";
+    }
+    return src;
+}
+
+template <typename F> double best_of(int runs, F f) {
+    double best{1e30};
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> took =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    source::Source src{};
+    if (argc > 1) {
+        src = source::Source::map(argv[1]);
+    } else {
+        src = source::Source(generate(20000));
+    }
+    int runs = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    std::size_t tokens{0};
+    double best = best_of(runs, [&] {
+        tokens = parser::Lexer(src.view()).parse_all().size();
+    });
+
+    double mb = src.view().size() / 1e6;
+    std::println("{:.2f} MB, {} tokens", mb, tokens);
+    std::println("lex, best of {}: {:.2f} ms, {:.1f} MB/s, {:.1f} Mtok/s", runs,
+                 best * 1e3, mb / best, tokens / best / 1e6);
+
+    // Validating and counting the whole input, against decoding it one code
+    // point at a time
+    std::size_t count{0};
+    double vectored = best_of(runs, [&] {
+        if (utf_invalid_at(src.view()) == std::string_view::npos)
+            count = utf_length(src.view());
+    });
+    double scalar = best_of(runs, [&] {
+        count = 0;
+        for (std::size_t i = 0, b = 0; i < src.view().size(); i += b) {
+            decode_utf(src.view(), i, b);
+            if (!b)
+                break;
+            ++count;
+        }
+    });
+    std::println("utf8, {} code points: {:.1f} MB/s validate+count, "
+                 "{:.1f} MB/s decoding ({:.1f}x)",
+                 count, mb / vectored, mb / scalar, scalar / vectored);
+}
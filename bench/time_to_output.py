@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+# Measures time from invoking charta until the program prints its first line,
+# once through the JIT and once through the C backend and gcc.
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+
+def first_line(cmd, cwd):
+    start = time.perf_counter()
+    proc = subprocess.Popen(cmd, cwd=cwd, stdout=subprocess.PIPE)
+    proc.stdout.readline()
+    elapsed = time.perf_counter() - start
+    proc.stdout.read()
+    proc.wait()
+    return elapsed
+
+
+def c_backend(charta, src, cwd):
+    start = time.perf_counter()
+    subprocess.run([charta, src], cwd=cwd, check=True, stdout=subprocess.DEVNULL)
+    return time.perf_counter() - start + first_line(
+        [Path(cwd) / ("out_" + Path(src).stem)], cwd
+    )
+
+
+def main():
+    if len(sys.argv) < 3:
+        print(f"usage: {sys.argv[0]} <charta> <source> [runs]", file=sys.stderr)
+        sys.exit(1)
+
+    charta = str(Path(sys.argv[1]).resolve())
+    src = str(Path(sys.argv[2]).resolve())
+    runs = int(sys.argv[3]) if len(sys.argv) > 3 else 5
+
+    with tempfile.TemporaryDirectory() as cwd:
+        jit = min(first_line([charta, src, "-jit"], cwd) for _ in range(runs))
+        gcc = min(c_backend(charta, src, cwd) for _ in range(runs))
+
+    print(f"jit: {jit * 1000:9.2f} ms")
+    print(f"c:   {gcc * 1000:9.2f} ms ({gcc / jit:.1f}x)")
+
+
+if __name__ == "__main__":
+    main()
@@ -4,11 +4,37 @@
 #include "core.pre.h"
 #endif
 #include <math.h>
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Where a runtime error on this thread unwinds to, while ch_try_call runs
+typedef struct {
+    jmp_buf env;
+    char *err;
+    size_t err_size;
+} ch_guard;
+
+static _Thread_local ch_guard *ch_current_guard = NULL;
+
+void ch_fail(char const *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    if (ch_current_guard) {
+        vsnprintf(ch_current_guard->err, ch_current_guard->err_size, fmt, args);
+        va_end(args);
+        longjmp(ch_current_guard->env, 1);
+    }
+    printf("ERR: ");
+    vprintf(fmt, args);
+    printf("\n");
+    va_end(args);
+    exit(1);
+}
+
 ch_string ch_str_new(char const *data) {
     ch_string str;
     size_t len = strlen(data);
@@ -64,8 +90,7 @@ char *ch_valk_name(ch_value_kind k) {
 
 char ch_valas_bool(ch_value v) {
     if (v.kind != CH_VALK_BOOL) {
-        printf("ERR: Expected 'bool', got '%s'\n", ch_valk_name(v.kind));
-        exit(1);
+        ch_fail("Expected 'bool', got '%s'", ch_valk_name(v.kind));
     }
     return v.value.b;
 }
@@ -134,9 +159,7 @@ ch_stack_node *ch_stk_args(ch_stack_node **from, size_t n, char is_rest) {
     if (n != 0) {
 
         if (*from == NULL) {
-            printf("ERR: Tried to pop '%zu' arguments, but stack is empty.\n",
-                   n);
-            exit(1);
+            ch_fail("Tried to pop '%zu' arguments, but stack is empty.", n);
         }
 
         args = *from;
@@ -145,10 +168,8 @@ ch_stack_node *ch_stk_args(ch_stack_node **from, size_t n, char is_rest) {
         for (size_t i = 1; i < n; ++i) {
             curr = curr->next;
             if (curr == NULL) {
-                printf("ERR: Tried to pop '%zu' arguments, but stack is too "
-                       "short.\n",
-                       n);
-                exit(1);
+                ch_fail("Tried to pop '%zu' arguments, but stack is too short.",
+                        n);
             }
         }
 
@@ -319,9 +340,8 @@ ch_stack_node *_mangle_(sub, "-")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT && b.kind == CH_VALK_FLOAT) {
         ch_stk_push(&local, ch_valof_float(a.value.f - b.value.f));
     } else {
-        printf("ERR: '-' expected two numbers, got '%s' and '%s'\n",
-               ch_valk_name(a.kind), ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'-' expected two numbers, got '%s' and '%s'",
+                ch_valk_name(a.kind), ch_valk_name(b.kind));
     }
     return local;
 }
@@ -339,9 +359,8 @@ ch_stack_node *_mangle_(add, "+")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT && b.kind == CH_VALK_FLOAT) {
         ch_stk_push(&local, ch_valof_float(a.value.f + b.value.f));
     } else {
-        printf("ERR: '+' expected two numbers, got '%s' and '%s'\n",
-               ch_valk_name(a.kind), ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'+' expected two numbers, got '%s' and '%s'",
+                ch_valk_name(a.kind), ch_valk_name(b.kind));
     }
     return local;
 }
@@ -366,13 +385,10 @@ ch_stack_node *_mangle_(pop, "pop")(ch_stack_node **full) {
 ch_stack_node *_mangle_(fst_pop, "fst!")(ch_stack_node **full) {
     ch_stack_node *local = ch_stk_args(full, 1, 0);
     if (local->val.kind != CH_VALK_STACK) {
-        printf("ERR: '⊢!' expected stack, got '%s'\n",
-               ch_valk_name(local->val.kind));
-        exit(1);
+        ch_fail("'⊢!' expected stack, got '%s'", ch_valk_name(local->val.kind));
     }
     if (local->val.value.stk == NULL) {
-        printf("ERR: '⊢!' got empty stack");
-        exit(1);
+        ch_fail("'⊢!' got empty stack");
     }
     ch_value val = ch_stk_pop(&local->val.value.stk);
     ch_stk_push(&local, val);
@@ -382,13 +398,10 @@ ch_stack_node *_mangle_(fst_pop, "fst!")(ch_stack_node **full) {
 ch_stack_node *_mangle_(fst, "fst")(ch_stack_node **full) {
     ch_stack_node *local = ch_stk_args(full, 1, 0);
     if (local->val.kind != CH_VALK_STACK) {
-        printf("ERR: '⊢' expected stack, got '%s'\n",
-               ch_valk_name(local->val.kind));
-        exit(1);
+        ch_fail("'⊢' expected stack, got '%s'", ch_valk_name(local->val.kind));
     }
     if (local->val.value.stk == NULL) {
-        printf("ERR: '⊢' got empty stack");
-        exit(1);
+        ch_fail("'⊢' got empty stack");
     }
     ch_value top = ch_valcpy(&local->val.value.stk->val);
     ch_stk_push(&local, top);
@@ -398,13 +411,10 @@ ch_stack_node *_mangle_(fst, "fst")(ch_stack_node **full) {
 ch_stack_node *_mangle_(lst_pop, "lst!")(ch_stack_node **full) {
     ch_stack_node *local = ch_stk_args(full, 1, 0);
     if (local->val.kind != CH_VALK_STACK) {
-        printf("ERR: '⊣!' expected stack, got '%s'\n",
-               ch_valk_name(local->val.kind));
-        exit(1);
+        ch_fail("'⊣!' expected stack, got '%s'", ch_valk_name(local->val.kind));
     }
     if (local->val.value.stk == NULL) {
-        printf("ERR: '⊣!' got empty stack");
-        exit(1);
+        ch_fail("'⊣!' got empty stack");
     }
     ch_stack_node *stk = local->val.value.stk;
     ch_stack_node *prev = NULL;
@@ -423,13 +433,10 @@ ch_stack_node *_mangle_(lst_pop, "lst!")(ch_stack_node **full) {
 ch_stack_node *_mangle_(lst, "lst")(ch_stack_node **full) {
     ch_stack_node *local = ch_stk_args(full, 1, 0);
     if (local->val.kind != CH_VALK_STACK) {
-        printf("ERR: '⊣' expected stack, got '%s'\n",
-               ch_valk_name(local->val.kind));
-        exit(1);
+        ch_fail("'⊣' expected stack, got '%s'", ch_valk_name(local->val.kind));
     }
     if (local->val.value.stk == NULL) {
-        printf("ERR: '⊣' got empty stack");
-        exit(1);
+        ch_fail("'⊣' got empty stack");
     }
     ch_stack_node *stk = local->val.value.stk;
     while (stk->next != NULL) {
@@ -463,8 +470,7 @@ ch_stack_node *_mangle_(less, "<")(ch_stack_node **full) {
     } else if (b.kind == CH_VALK_FLOAT) {
         b_val = b.value.f;
     } else {
-        printf("ERR: '<' expected number, got '%s'\n", ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'<' expected number, got '%s'", ch_valk_name(b.kind));
     }
     float a_val;
     if (a.kind == CH_VALK_INT) {
@@ -472,8 +478,7 @@ ch_stack_node *_mangle_(less, "<")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT) {
         a_val = a.value.f;
     } else {
-        printf("ERR: '<' expected number, got '%s'\n", ch_valk_name(a.kind));
-        exit(1);
+        ch_fail("'<' expected number, got '%s'", ch_valk_name(a.kind));
     }
     ch_stk_push(&local, ch_valof_bool(a_val < b_val));
     return local;
@@ -488,8 +493,7 @@ ch_stack_node *_mangle_(grt, ">")(ch_stack_node **full) {
     } else if (b.kind == CH_VALK_FLOAT) {
         b_val = b.value.f;
     } else {
-        printf("ERR: '>' expected number, got '%s'\n", ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'>' expected number, got '%s'", ch_valk_name(b.kind));
     }
     float a_val;
     if (a.kind == CH_VALK_INT) {
@@ -497,8 +501,7 @@ ch_stack_node *_mangle_(grt, ">")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT) {
         a_val = a.value.f;
     } else {
-        printf("ERR: '>' expected number, got '%s'\n", ch_valk_name(a.kind));
-        exit(1);
+        ch_fail("'>' expected number, got '%s'", ch_valk_name(a.kind));
     }
     ch_stk_push(&local, ch_valof_bool(a_val > b_val));
     return local;
@@ -513,8 +516,7 @@ ch_stack_node *_mangle_(less_equ, "<=")(ch_stack_node **full) {
     } else if (b.kind == CH_VALK_FLOAT) {
         b_val = b.value.f;
     } else {
-        printf("ERR: '<=' expected number, got '%s'\n", ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'<=' expected number, got '%s'", ch_valk_name(b.kind));
     }
     float a_val;
     if (a.kind == CH_VALK_INT) {
@@ -522,8 +524,7 @@ ch_stack_node *_mangle_(less_equ, "<=")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT) {
         a_val = a.value.f;
     } else {
-        printf("ERR: '<=' expected number, got '%s'\n", ch_valk_name(a.kind));
-        exit(1);
+        ch_fail("'<=' expected number, got '%s'", ch_valk_name(a.kind));
     }
     ch_stk_push(&local, ch_valof_bool(a_val <= b_val));
     return local;
@@ -538,8 +539,7 @@ ch_stack_node *_mangle_(grt_equ, ">=")(ch_stack_node **full) {
     } else if (b.kind == CH_VALK_FLOAT) {
         b_val = b.value.f;
     } else {
-        printf("ERR: '>=' expected number, got '%s'\n", ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'>=' expected number, got '%s'", ch_valk_name(b.kind));
     }
     float a_val;
     if (a.kind == CH_VALK_INT) {
@@ -547,8 +547,7 @@ ch_stack_node *_mangle_(grt_equ, ">=")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT) {
         a_val = a.value.f;
     } else {
-        printf("ERR: '>=' expected number, got '%s'\n", ch_valk_name(a.kind));
-        exit(1);
+        ch_fail("'>=' expected number, got '%s'", ch_valk_name(a.kind));
     }
     ch_stk_push(&local, ch_valof_bool(a_val >= b_val));
     return local;
@@ -567,9 +566,8 @@ ch_stack_node *_mangle_(mult, "*")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT && b.kind == CH_VALK_FLOAT) {
         ch_stk_push(&local, ch_valof_float(a.value.f * b.value.f));
     } else {
-        printf("ERR: '*' expected two numbers, got '%s' and '%s'\n",
-               ch_valk_name(a.kind), ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'*' expected two numbers, got '%s' and '%s'",
+                ch_valk_name(a.kind), ch_valk_name(b.kind));
     }
     return local;
 }
@@ -586,9 +584,8 @@ ch_stack_node *_mangle_(divd, "/")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT && b.kind == CH_VALK_FLOAT) {
         ch_stk_push(&local, ch_valof_float(a.value.f / b.value.f));
     } else {
-        printf("ERR: '/' expected two numbers, got '%s' and '%s'\n",
-               ch_valk_name(a.kind), ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'/' expected two numbers, got '%s' and '%s'",
+                ch_valk_name(a.kind), ch_valk_name(b.kind));
     }
     return local;
 }
@@ -605,9 +602,8 @@ ch_stack_node *_mangle_(mod, "%")(ch_stack_node **full) {
     } else if (a.kind == CH_VALK_FLOAT && b.kind == CH_VALK_FLOAT) {
         ch_stk_push(&local, ch_valof_float(fmodf(a.value.f, b.value.i)));
     } else {
-        printf("ERR: '%%' expected two numbers, got '%s' and '%s'\n",
-               ch_valk_name(a.kind), ch_valk_name(b.kind));
-        exit(1);
+        ch_fail("'%%' expected two numbers, got '%s' and '%s'",
+                ch_valk_name(a.kind), ch_valk_name(b.kind));
     }
     return local;
 }
@@ -615,9 +611,8 @@ ch_stack_node *_mangle_(mod, "%")(ch_stack_node **full) {
 ch_stack_node *_mangle_(ins, "ins")(ch_stack_node **full) {
     ch_stack_node *local = ch_stk_args(full, 2, 0);
     if (local->next->val.kind != CH_VALK_STACK) {
-        printf("ERR: 'ins' expected stack, got '%s'",
-               ch_valk_name(local->next->val.kind));
-        exit(1);
+        ch_fail("'ins' expected stack, got '%s'",
+                ch_valk_name(local->next->val.kind));
     }
     ch_value val = ch_stk_pop(&local);
     ch_stk_push(&local->val.value.stk, val);
@@ -633,3 +628,81 @@ ch_stack_node *_mangle_(rot_rev, "rot-")(ch_stack_node **full) {
     local->next = rest;
     return b;
 }
+
+ch_stack_node *_mangle_(dup2, "⇈")(ch_stack_node **full) {
+    return _mangle_(dup, "dup")(full);
+}
+
+ch_stack_node *_mangle_(swp2, "↕")(ch_stack_node **full) {
+    return _mangle_(swp, "swp")(full);
+}
+
+ch_stack_node *_mangle_(rot2, "↻")(ch_stack_node **full) {
+    return _mangle_(rot, "rot")(full);
+}
+
+ch_stack_node *_mangle_(rot_rev2, "↷")(ch_stack_node **full) {
+    return _mangle_(rot_rev, "rot-")(full);
+}
+
+ch_stack_node *_mangle_(nequ2, "≠")(ch_stack_node **full) {
+    return _mangle_(nequ, "!=")(full);
+}
+
+ch_stack_node *_mangle_(less_equ2, "≤")(ch_stack_node **full) {
+    return _mangle_(less_equ, "<=")(full);
+}
+
+ch_stack_node *_mangle_(grt_equ2, "≥")(ch_stack_node **full) {
+    return _mangle_(grt_equ, ">=")(full);
+}
+
+ch_stack_node *_mangle_(boxstk2, "▭")(ch_stack_node **full) {
+    return _mangle_(boxstk, "box")(full);
+}
+
+ch_stack_node *_mangle_(pop2, "◌")(ch_stack_node **full) {
+    return _mangle_(pop, "pop")(full);
+}
+
+ch_stack_node *_mangle_(fst_pop2, "⊢!")(ch_stack_node **full) {
+    return _mangle_(fst_pop, "fst!")(full);
+}
+
+ch_stack_node *_mangle_(fst2, "⊢")(ch_stack_node **full) {
+    return _mangle_(fst, "fst")(full);
+}
+
+ch_stack_node *_mangle_(lst_pop2, "⊣!")(ch_stack_node **full) {
+    return _mangle_(lst_pop, "lst!")(full);
+}
+
+ch_stack_node *_mangle_(lst2, "⊣")(ch_stack_node **full) {
+    return _mangle_(lst, "lst")(full);
+}
+
+ch_stack_node *_mangle_(ins2, "⤓")(ch_stack_node **full) {
+    return _mangle_(ins, "ins")(full);
+}
+
+int ch_try_call(ch_builtin_fn fn, ch_stack_node **stk, ch_stack_node **rets,
+                char *err, size_t err_size) {
+    ch_guard guard;
+    guard.err = err;
+    guard.err_size = err_size;
+    ch_guard *outer = ch_current_guard;
+    if (setjmp(guard.env)) {
+        ch_current_guard = outer;
+        *rets = NULL;
+        return 1;
+    }
+    ch_current_guard = &guard;
+    *rets = fn(stk);
+    ch_current_guard = outer;
+    return 0;
+}
+
+// One entry per builtin in src/builtins.hpp, written in by process.py
+ch_builtin const ch_builtins[] = {
+    _builtins_
+    {NULL, NULL}};
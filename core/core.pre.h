@@ -50,6 +50,10 @@ char ch_valas_bool(ch_value v);
 
 void ch_val_delete(ch_value *val);
 
+// Reports a runtime error and does not return. Inside ch_try_call it unwinds
+// to the call with the message, otherwise it prints it and exits.
+__attribute__((noreturn)) void ch_fail(char const *fmt, ...);
+
 typedef struct ch_stack_node {
     ch_value val;
     struct ch_stack_node *next;
@@ -72,39 +76,25 @@ void ch_stk_delete(ch_stack_node **stk);
 ch_stack_node *_mangle_(print, "print")(ch_stack_node **full);
 
 ch_stack_node *_mangle_(dup, "dup")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(dup2, "⇈")(ch_stack_node **full) {
-    return _mangle_(dup, "dup")(full);
-}
+ch_stack_node *_mangle_(dup2, "⇈")(ch_stack_node **full);
 ch_stack_node *_mangle_(swp, "swp")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(swp2, "↕")(ch_stack_node **full) {
-    return _mangle_(swp, "swp")(full);
-}
+ch_stack_node *_mangle_(swp2, "↕")(ch_stack_node **full);
 ch_stack_node *_mangle_(rot, "rot")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(rot2, "↻")(ch_stack_node **full) {
-    return _mangle_(rot, "rot")(full);
-}
+ch_stack_node *_mangle_(rot2, "↻")(ch_stack_node **full);
 ch_stack_node *_mangle_(rot_rev, "rot-")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(rot_rev2, "↷")(ch_stack_node **full) {
-    return _mangle_(rot_rev, "rot-")(full);
-}
+ch_stack_node *_mangle_(rot_rev2, "↷")(ch_stack_node **full);
 
 ch_stack_node *_mangle_(dbg, "dbg")(ch_stack_node **full);
 
 ch_stack_node *_mangle_(equ_cmp, "=")(ch_stack_node **full);
 ch_stack_node *_mangle_(nequ, "!=")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(nequ2, "≠")(ch_stack_node **full) {
-    return _mangle_(nequ, "!=")(full);
-}
+ch_stack_node *_mangle_(nequ2, "≠")(ch_stack_node **full);
 ch_stack_node *_mangle_(less, "<")(ch_stack_node **full);
 ch_stack_node *_mangle_(grt, ">")(ch_stack_node **full);
 ch_stack_node *_mangle_(less_equ, "<=")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(less_equ2, "≤")(ch_stack_node **full) {
-    return _mangle_(less_equ, "<=")(full);
-}
+ch_stack_node *_mangle_(less_equ2, "≤")(ch_stack_node **full);
 ch_stack_node *_mangle_(grt_equ, ">=")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(grt_equ2, "≥")(ch_stack_node **full) {
-    return _mangle_(grt_equ, ">=")(full);
-}
+ch_stack_node *_mangle_(grt_equ2, "≥")(ch_stack_node **full);
 
 ch_stack_node *_mangle_(add, "+")(ch_stack_node **full);
 ch_stack_node *_mangle_(sub, "-")(ch_stack_node **full);
@@ -113,33 +103,35 @@ ch_stack_node *_mangle_(divd, "/")(ch_stack_node **full);
 ch_stack_node *_mangle_(mod, "%")(ch_stack_node **full);
 
 ch_stack_node *_mangle_(boxstk, "box")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(boxstk2, "▭")(ch_stack_node **full) {
-    return _mangle_(boxstk, "box")(full);
-}
+ch_stack_node *_mangle_(boxstk2, "▭")(ch_stack_node **full);
 
 ch_stack_node *_mangle_(pop, "pop")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(pop2, "◌")(ch_stack_node **full) {
-    return _mangle_(pop, "pop")(full);
-}
+ch_stack_node *_mangle_(pop2, "◌")(ch_stack_node **full);
 
 ch_stack_node *_mangle_(fst_pop, "fst!")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(fst_pop2, "⊢!")(ch_stack_node **full) {
-    return _mangle_(fst_pop, "fst!")(full);
-}
+ch_stack_node *_mangle_(fst_pop2, "⊢!")(ch_stack_node **full);
 ch_stack_node *_mangle_(fst, "fst")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(fst2, "⊢")(ch_stack_node **full) {
-    return _mangle_(fst, "fst")(full);
-}
+ch_stack_node *_mangle_(fst2, "⊢")(ch_stack_node **full);
 
 ch_stack_node *_mangle_(lst_pop, "lst!")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(lst_pop2, "⊣!")(ch_stack_node **full) {
-    return _mangle_(lst_pop, "lst!")(full);
-}
+ch_stack_node *_mangle_(lst_pop2, "⊣!")(ch_stack_node **full);
 ch_stack_node *_mangle_(lst, "lst")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(lst2, "⊣")(ch_stack_node **full) {
-    return _mangle_(lst, "lst")(full);
-}
+ch_stack_node *_mangle_(lst2, "⊣")(ch_stack_node **full);
 ch_stack_node *_mangle_(ins, "ins")(ch_stack_node **full);
-static inline ch_stack_node *_mangle_(ins2, "⤓")(ch_stack_node **full) {
-    return _mangle_(ins, "ins")(full);
-}
+ch_stack_node *_mangle_(ins2, "⤓")(ch_stack_node **full);
+
+typedef ch_stack_node *(*ch_builtin_fn)(ch_stack_node **full);
+
+typedef struct {
+    char const *name;
+    ch_builtin_fn fn;
+} ch_builtin;
+
+// Every builtin by its Charta name, terminated by a NULL name.
+extern ch_builtin const ch_builtins[];
+
+// Runs fn on *stk and stores what it returns in *rets. A runtime error in
+// fn makes it return nonzero with the message in err instead, leaving *rets
+// NULL; the values fn had taken off *stk by then are leaked.
+int ch_try_call(ch_builtin_fn fn, ch_stack_node **stk, ch_stack_node **rets,
+                char *err, size_t err_size);
@@ -36,6 +36,18 @@ def main():
         return cache[ascii_arg]
 
     new_text = pattern.sub(replace, text)
+
+    # The runtime's table of builtins is listed by the mangler from
+    # src/builtins.hpp
+    builtins = re.compile(r'^[ \t]*_builtins_[ \t]*\n', re.MULTILINE)
+    if builtins.search(new_text):
+        result = subprocess.run(
+            [mangler_path, "--builtins"],
+            check=True,
+            stdout=subprocess.PIPE,
+            text=True,
+        )
+        new_text = builtins.sub(lambda _: result.stdout, new_text)
     out_path.write_text(new_text)
 
 if __name__ == "__main__":
@@ -6,6 +6,14 @@ out="$2"
 
 cp "$in" "$out"
 
+# The runtime's table of builtins is listed by the mangler from
+# src/builtins.hpp
+if grep -q '^[[:space:]]*_builtins_[[:space:]]*$' "$in"; then
+    ./mangler --builtins > "$out.builtins"
+    sed -i -e "/^[[:space:]]*_builtins_[[:space:]]*\$/{r $out.builtins" -e 'd}' "$out"
+    rm "$out.builtins"
+fi
+
 sed -n 's/.*\(_mangle_([^"]*"[^"]*")\).*/\1/p' "$in" |
 sort -u |
 while read -r macro; do
@@ -1,17 +1,30 @@
 #include "builder.hpp"
+#include "builtins.hpp"
 #include "checks.hpp"
+#include "ircache.hpp"
+#include "jit.hpp"
+#include "make_asm.hpp"
 #include "make_c.hpp"
+#include "make_llvm.hpp"
 #include "parser.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
 #include "traverser.hpp"
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
 #include <print>
+#include <thread>
+#include <unordered_set>
 
 std::vector<parser::TopLevel> builder::Builder::parse() {
     try {
-        auto tokens = parser::Lexer(input).parse_all();
-        auto decls = parser::Parser(std::move(tokens)).parse_program();
-        return decls;
+        return parser::parse_source(input.view());
     } catch (parser::ParserError e) {
         error(e.start, e.end, e.what);
     }
@@ -19,44 +32,254 @@ std::vector<parser::TopLevel> builder::Builder::parse() {
     return {};
 }
 
-std::vector<traverser::Function> builder::Builder::traverse() {
-    std::vector<traverser::Function> fns{};
-    auto decls = parse();
-    if (show_ir) {
-        std::println("\n== IR ==");
+std::vector<parser::FnSig> builder::Builder::outline() {
+    try {
+        return parser::outline_source(input.view());
+    } catch (parser::ParserError e) {
+        error(e.start, e.end, e.what);
+    }
+    error("Unreachable path");
+    return {};
+}
+
+// The IR of one declaration, or why it has none
+static std::optional<std::string> traverse_decl(parser::FnDecl const &fn,
+                                                traverser::Function &out) {
+    try {
+        out = traverser::Function{fn.name, fn.args, fn.rets,
+                                  traverser::traverse(fn.body)};
+    } catch (traverser::TraverserError e) {
+        return std::format("In {}, at ({}, {}): {}", symbols::name(fn.name),
+                           e.x, e.y, e.what);
     }
+    return {};
+}
+
+// Which of the declarations named in names are reachable from main, or all
+// of them for a library. Each wave of newly found declarations is handed to
+// visit along with want, which visit calls on every function they call.
+template <typename Visit>
+static std::vector<bool> reachable(std::vector<symbols::Id> const &names,
+                                   bool everything, Visit visit) {
+    symbols::Table<std::vector<std::size_t>> by_name{};
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        by_name[names[i]].emplace_back(i);
+    }
+    std::vector<bool> wanted(names.size(), false);
+    std::vector<std::size_t> frontier{};
+    auto want = [&](symbols::Id name) {
+        if (auto found = by_name.find(name)) {
+            for (auto i : *found) {
+                if (!wanted[i]) {
+                    wanted[i] = true;
+                    frontier.emplace_back(i);
+                }
+            }
+        }
+    };
+    if (everything) {
+        for (auto name : names) {
+            want(name);
+        }
+    } else {
+        want(symbols::intern("main"));
+    }
+    while (!frontier.empty()) {
+        auto wave = std::move(frontier);
+        frontier.clear();
+        visit(wave, want);
+    }
+    return wanted;
+}
+
+std::vector<traverser::Function> builder::Builder::traverse_reachable() {
+    auto decls = parse();
+    std::vector<parser::FnDecl const *> fn_decls{};
+    std::vector<symbols::Id> names{};
     for (auto &decl : decls) {
         if (auto fn = std::get_if<parser::FnDecl>(&decl)) {
-            try {
-                auto ir = traverser::traverse(fn->body);
-                if (show_ir) {
-                    std::println("fn {}\n", fn->name);
-                    for (auto &i : ir) {
-                        std::println("  {}", i.show());
-                    }
-                    std::println("\n");
+            fn_decls.emplace_back(fn);
+            names.emplace_back(fn->name);
+        }
+    }
+
+    // Only functions reachable from main are traversed, checked and
+    // generated. A library exports everything, so there all of them are.
+    // Functions are traversed independently; results are kept by position so
+    // the IR dump and the first reported error do not depend on scheduling.
+    std::vector<traverser::Function> traversed(fn_decls.size());
+    std::vector<std::optional<std::string>> errors(fn_decls.size());
+    auto wanted = reachable(names, as_library, [&](auto const &wave,
+                                                   auto &&want) {
+        pool::shared().for_each(wave.size(), [&](std::size_t k) {
+            errors[wave[k]] = traverse_decl(*fn_decls[wave[k]],
+                                            traversed[wave[k]]);
+        });
+        for (auto i : wave) {
+            for (auto const &instr : traversed[i].body) {
+                if (instr.kind == ir::Instruction::Call) {
+                    want(instr.callee());
                 }
-                fns.emplace_back(
-                    traverser::Function{fn->name, fn->args, fn->rets, ir});
-            } catch (traverser::TraverserError e) {
-                error(std::format("In {}, at ({}, {}): {}", fn->name, e.x, e.y,
-                                  e.what));
             }
         }
+    });
+
+    std::vector<traverser::Function> fns{};
+    for (std::size_t i = 0; i < fn_decls.size(); ++i) {
+        if (errors[i]) {
+            error(*errors[i]);
+        }
+        if (wanted[i]) {
+            fns.emplace_back(std::move(traversed[i]));
+        }
+    }
+    return fns;
+}
+
+std::vector<traverser::Function> builder::Builder::traverse() {
+    std::optional<ircache::Key> key{};
+    if (use_cache || memo) {
+        key = ircache::key_of(input.view(), as_library);
+    }
+    if (memo) {
+        if (auto warm = memo->find(filename, *key)) {
+            facts = warm->facts;
+            return warm->fns;
+        }
     }
+    std::vector<traverser::Function> fns{};
+    if (use_cache) {
+        // Checking starts from the saved IR when the source is unchanged
+        auto path = ircache::path_for(filename);
+        if (auto cache = ircache::Cache::open(path, *key)) {
+            fns = cache->functions();
+        } else {
+            fns = traverse_reachable();
+            ircache::write(path, *key, fns);
+        }
+    } else {
+        fns = traverse_reachable();
+    }
+
     if (show_ir) {
+        std::println("\n== IR ==");
+        for (auto &fn : fns) {
+            std::println("fn {}\n", symbols::name(fn.name));
+            for (auto &instr : fn.body) {
+                std::println("  {}", fn.body.show(instr));
+            }
+            std::println("\n");
+        }
         std::println("== End IR ==\n");
     }
     try {
-        checks::TypeChecker(fns, show_typecheck).check();
+        facts = checks::TypeChecker(fns, show_typecheck).check();
     } catch (checks::CheckError e) {
         error(std::format("In function {}: {}", e.fname, e.what));
     }
+    if (memo) {
+        memo->store(filename, std::make_shared<Memo::Entry const>(
+                                  Memo::Entry{*key, fns, facts}));
+    }
     return fns;
 }
-std::string builder::Builder::generate() {
-    auto fns = traverse();
-    std::string code{backend::c::make_c(fns)};
+std::vector<traverser::Function>
+builder::Builder::stream(std::filesystem::path const &file,
+                         backend::c::Options const &opts) {
+    auto sigs = outline();
+    std::vector<symbols::Id> names{};
+    for (auto const &sig : sigs) {
+        names.emplace_back(sig.name);
+    }
+
+    // Finding what is reachable traverses every wanted function once, one at
+    // a time, and keeps only what it calls. Each is traversed again when it
+    // is generated, which is the price of never holding two at once.
+    std::vector<std::optional<std::string>> errors(sigs.size());
+    auto wanted = reachable(names, as_library, [&](auto const &wave,
+                                                   auto &&want) {
+        for (auto i : wave) {
+            traverser::Function fn{};
+            errors[i] = traverse_decl(
+                parser::parse_at(input.view(), sigs[i].span), fn);
+            for (auto const &instr : fn.body) {
+                if (instr.kind == ir::Instruction::Call) {
+                    want(instr.callee());
+                }
+            }
+        }
+    });
+
+    std::vector<std::size_t> order{};
+    std::vector<traverser::Function> fns{};
+    for (std::size_t i = 0; i < sigs.size(); ++i) {
+        if (errors[i]) {
+            error(*errors[i]);
+        }
+        if (wanted[i]) {
+            order.emplace_back(i);
+            fns.emplace_back(traverser::Function{sigs[i].name, sigs[i].args,
+                                                 sigs[i].rets, {}});
+        }
+    }
+
+    std::optional<checks::TypeChecker> checker{};
+    try {
+        checker.emplace(fns, show_typecheck);
+    } catch (checks::CheckError e) {
+        error(std::format("In function {}: {}", e.fname, e.what));
+    }
+    std::ofstream out{file};
+    out << backend::c::make_prelude(fns, opts);
+    if (show_ir) {
+        std::println("\n== IR ==");
+    }
+    for (auto i : order) {
+        traverser::Function fn{};
+        traverse_decl(parser::parse_at(input.view(), sigs[i].span), fn);
+        if (show_ir) {
+            std::println("fn {}\n", symbols::name(fn.name));
+            for (auto &instr : fn.body) {
+                std::println("  {}", fn.body.show(instr));
+            }
+            std::println("\n");
+        }
+        try {
+            checker->check(fn);
+        } catch (checks::CheckError e) {
+            out.close();
+            std::filesystem::remove(file);
+            error(std::format("In function {}: {}", e.fname, e.what));
+        }
+        out << backend::c::make_function(fn, opts);
+    }
+    if (show_ir) {
+        std::println("== End IR ==\n");
+    }
+    out << backend::c::make_entry(fns, opts);
+    out.close();
+    if (show_gen) {
+        std::println("\n== Source ==");
+        std::cout << std::ifstream(file).rdbuf() << std::endl;
+        std::println("== End Source ==\n");
+    }
+    return fns;
+}
+std::string
+builder::Builder::generate(std::vector<traverser::Function> const &fns,
+                           backend::c::Options const &opts) {
+    std::string code{};
+    switch (backend) {
+    case Backend::C:
+        code = backend::c::make_c(fns, opts);
+        break;
+    case Backend::Llvm:
+        code = backend::llvm::make_llvm(fns, facts);
+        break;
+    case Backend::Asm:
+        code = backend::x86::make_asm(fns, facts);
+        break;
+    }
     if (show_gen) {
         std::println("\n== Source ==");
         std::println("{}", code);
@@ -65,28 +288,519 @@ std::string builder::Builder::generate() {
     return code;
 }
 void builder::Builder::build(std::filesystem::path root, std::string out_file) {
-    std::string out{generate()};
-    std::string cmd{std::format(
-        "gcc -ggdb -fsanitize=address,leak -x c - -x none {} "
-        "-I{} -o {} -lm",
-        (root / "libcore.a").string(), (root / "core").string(), out_file)};
+    if (pgo != Pgo::Off && backend != Backend::C) {
+        error("Profile-guided builds need the C backend");
+    }
+    if (as_library && backend != Backend::C) {
+        error("Shared libraries need the C backend");
+    }
+    if (streaming && (pgo != Pgo::Off || backend != Backend::C)) {
+        error("Streaming builds need the C backend without profiles");
+    }
+    std::string out_path{std::filesystem::absolute(out_file).string()};
+    std::string charta_profile{out_path + ".chprof"};
+    std::string gcc_profile{out_path + ".gcprof"};
+    std::optional<profile::Profile> prof{};
+    backend::c::Options opts{};
+    std::string cflags{"-ggdb -fsanitize=address,leak"};
+    switch (pgo) {
+    case Pgo::Off:
+        break;
+    case Pgo::Generate:
+        opts.instrument = charta_profile;
+        cflags = std::format("-O2 -fprofile-generate={} "
+                             "-fprofile-update=atomic",
+                             gcc_profile);
+        break;
+    case Pgo::Use:
+        prof = profile::read_profile(charta_profile);
+        if (!prof) {
+            error(std::format("No usable profile at '{}', build with "
+                              "-pgo-gen and run the program first",
+                              charta_profile));
+        }
+        opts.profile = &*prof;
+        // The instrumented C differs from this one, so gcc only applies
+        // its profile to the functions whose control flow still matches
+        cflags = std::format("-O2 -fprofile-use={} -fprofile-partial-training "
+                             "-Wno-missing-profile -Wno-coverage-mismatch",
+                             gcc_profile);
+        break;
+    }
+    if (as_library) {
+        // Hosts bring their own allocator and sanitizers, if any
+        opts.library = true;
+        if (pgo == Pgo::Off) {
+            cflags = "-O2";
+        }
+        cflags += " -fPIC -shared";
+    }
+    // A streamed program is written to a file next to the output as it is
+    // generated, and gcc reads it from there instead of from a pipe
+    std::string out{};
+    std::string c_input{"-"};
+    std::optional<std::filesystem::path> streamed{};
+    std::vector<traverser::Function> fns{};
+    if (streaming) {
+        streamed = out_path + ".stream.c";
+        c_input = streamed->string();
+        fns = stream(*streamed, opts);
+    } else {
+        fns = traverse();
+        out = generate(fns, opts);
+    }
+    if (as_library) {
+        auto header = std::filesystem::path(out_file).replace_extension(".h");
+        std::ofstream(header) << backend::c::make_header(fns);
+    }
+    std::string cmd{};
+    switch (backend) {
+    case Backend::C:
+        cmd = std::format("gcc {} -x c {} -x none {} -I{} -o {} -lm", cflags,
+                          c_input, (root / "libcore.a").string(),
+                          (root / "core").string(), out_file);
+        break;
+    case Backend::Llvm:
+        cmd = std::format("clang -O2 -x ir - -x none {} -o {} -lm",
+                          (root / "libcore.a").string(), out_file);
+        break;
+    case Backend::Asm:
+        cmd = std::format("as --64 -o {0}.o && gcc {0}.o {1} -o {0} -lm && "
+                          "rm {0}.o",
+                          out_file, (root / "libcore.a").string());
+        break;
+    }
     if (show_command) {
         std::println("Command: {}", cmd);
     }
     FILE *gcc = popen(cmd.data(), "w");
     fputs(out.data(), gcc);
-    pclose(gcc);
+    bool built = pclose(gcc) == 0;
+    if (streamed) {
+        std::filesystem::remove(*streamed);
+    }
+    if (!built) {
+        error(std::format("Could not build {}", out_file));
+    }
+}
+
+void builder::Builder::run() {
+    auto fns = traverse();
+    try {
+        auto module = backend::jit::make_jit(std::move(fns));
+        if (show_gen) {
+            std::println("\n== JIT ==");
+            std::println("{} bytes of machine code", module.size());
+            std::println("== End JIT ==\n");
+        }
+        module.run("main");
+    } catch (backend::jit::JitError e) {
+        error(e.what);
+    }
+}
+
+std::vector<builder::Builder::Unit>
+builder::Builder::relex(source::Source const &next) {
+    auto before = input.view();
+    auto after = next.view();
+    auto limit = std::min(before.size(), after.size());
+    std::size_t prefix = std::mismatch(before.begin(), before.begin() + limit,
+                                       after.begin())
+                             .first -
+                         before.begin();
+    std::size_t suffix{0};
+    while (suffix < limit - prefix &&
+           before[before.size() - 1 - suffix] ==
+               after[after.size() - 1 - suffix]) {
+        ++suffix;
+    }
+
+    // Declarations wholly before the edit stay where they are. Those after
+    // it move with the end of the file, as long as the line break before
+    // them is untouched and so still ends whatever the edit left there.
+    std::size_t front{0};
+    while (front < units.size() && units[front].sig.span.end <= prefix) {
+        ++front;
+    }
+    std::size_t back{units.size()};
+    while (back > front) {
+        auto start = units[back - 1].sig.span.start;
+        if (start == 0 || start - 1 < before.size() - suffix ||
+            before[start - 1] != '\n') {
+            break;
+        }
+        --back;
+    }
+    auto moved = [&](std::size_t offset) {
+        return offset + after.size() - before.size();
+    };
+
+    // Only the text in between is lexed and parsed again
+    parser::Span edited{front > 0 ? units[front - 1].sig.span.end : 0,
+                        back < units.size() ? moved(units[back].sig.span.start)
+                                            : after.size()};
+    auto sigs = parser::outline_source(after, edited);
+
+    std::vector<Unit> next_units{};
+    for (std::size_t i = 0; i < front; ++i) {
+        next_units.emplace_back(std::move(units[i]));
+    }
+    auto text_of = [](std::string_view source, parser::Span span) {
+        return source.substr(span.start, span.end - span.start);
+    };
+    std::vector<bool> taken(back - front, false);
+    for (auto &sig : sigs) {
+        auto text = text_of(after, sig.span);
+        auto hash = std::hash<std::string_view>{}(text);
+        // A declaration the edit only moved keeps what was known of it. The
+        // hash only narrows the search; the old text has the final say.
+        std::size_t same{front};
+        while (same < back &&
+               (taken[same - front] || units[same].hash != hash ||
+                text_of(before, units[same].sig.span) != text)) {
+            ++same;
+        }
+        if (same != back) {
+            taken[same - front] = true;
+            next_units.emplace_back(std::move(units[same]));
+            next_units.back().sig = std::move(sig);
+        } else {
+            next_units.emplace_back(Unit{std::move(sig), hash});
+        }
+    }
+    for (std::size_t i = back; i < units.size(); ++i) {
+        auto &unit = next_units.emplace_back(std::move(units[i]));
+        unit.sig.span = {moved(unit.sig.span.start), moved(unit.sig.span.end)};
+    }
+    return next_units;
+}
+
+// What checking a call depends on: the types a function takes and returns
+static std::string signature_key(parser::FnSig const &sig) {
+    auto show = [](parser::TypeSig const &type) {
+        return type.is_stack ? "[" + type.name + "]" : type.name;
+    };
+    std::string key{};
+    for (auto const &[name, type] : sig.args.args) {
+        key += show(type) + " ";
+    }
+    if (sig.args.kind == parser::Argument::Ellipses) {
+        key += "... ";
+    }
+    key += "->";
+    for (auto const &type : sig.rets.args) {
+        key += " " + show(type);
+    }
+    if (sig.rets.rest) {
+        key += " ... " + show(*sig.rets.rest);
+    }
+    return key;
+}
+
+// Runs a compiler command, with its output going to ours
+static bool run_command(std::string const &cmd, bool show_command) {
+    if (show_command) {
+        std::println("Command: {}", cmd);
+    }
+    FILE *process = popen(cmd.data(), "w");
+    return process && pclose(process) == 0;
+}
+
+void builder::Builder::rebuild(std::filesystem::path const &root,
+                               std::filesystem::path const &objects,
+                               std::string const &out_file) {
+    auto started = std::chrono::steady_clock::now();
+    auto report = [](std::string const &what) {
+        std::println("Err: {}", what);
+    };
+    // Read into memory rather than mapped: editors that write the file in
+    // place would change a mapping under the text the next edit is
+    // compared with
+    std::ifstream file{filename, std::ios::binary};
+    std::string text{std::istreambuf_iterator<char>(file), {}};
+    if (!file) {
+        return report(std::format("Could not read '{}'", filename));
+    }
+    source::Source next{std::move(text)};
+    try {
+        units = relex(next);
+    } catch (parser::ParserError e) {
+        return report(e.what);
+    }
+    input = std::move(next);
+
+    std::vector<symbols::Id> names{};
+    for (auto const &unit : units) {
+        names.emplace_back(unit.sig.name);
+    }
+    std::size_t traversed{0};
+    auto wanted = reachable(names, as_library, [&](auto const &wave,
+                                                   auto &&want) {
+        std::vector<std::size_t> fresh{};
+        for (auto i : wave) {
+            if (!units[i].fn && !units[i].traverse_error) {
+                fresh.emplace_back(i);
+            }
+        }
+        traversed += fresh.size();
+        pool::shared().for_each(fresh.size(), [&](std::size_t k) {
+            auto &unit = units[fresh[k]];
+            traverser::Function fn{};
+            unit.traverse_error = traverse_decl(
+                parser::parse_at(input.view(), unit.sig.span), fn);
+            if (!unit.traverse_error) {
+                unit.fn = std::move(fn);
+            }
+        });
+        for (auto i : wave) {
+            if (units[i].fn) {
+                for (auto const &instr : units[i].fn->body) {
+                    if (instr.kind == ir::Instruction::Call) {
+                        want(instr.callee());
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<Unit *> live{};
+    for (std::size_t i = 0; i < units.size(); ++i) {
+        if (wanted[i]) {
+            live.emplace_back(&units[i]);
+        } else {
+            // Nothing keeps its check up to date while it is unused
+            units[i].checked = false;
+        }
+    }
+    for (auto unit : live) {
+        if (unit->traverse_error) {
+            return report(*unit->traverse_error);
+        }
+    }
+
+    // A function is checked again when its IR is new, or when the
+    // signature of something it calls changed or came or went
+    std::unordered_map<symbols::Id, std::string> sigs{};
+    for (auto unit : live) {
+        sigs[unit->sig.name] = signature_key(unit->sig);
+    }
+    std::unordered_set<symbols::Id> changed{};
+    for (auto const &[name, key] : sigs) {
+        if (auto old = checked_sigs.find(name);
+            old == checked_sigs.end() || old->second != key) {
+            changed.insert(name);
+        }
+    }
+    for (auto const &[name, key] : checked_sigs) {
+        if (!sigs.contains(name)) {
+            changed.insert(name);
+        }
+    }
+    checked_sigs = std::move(sigs);
+    std::vector<traverser::Function> fns{};
+    std::vector<Unit *> pending{};
+    for (auto unit : live) {
+        if (unit->checked &&
+            std::any_of(unit->fn->body.begin(), unit->fn->body.end(),
+                        [&](ir::Instruction const &instr) {
+                            return instr.kind == ir::Instruction::Call &&
+                                   changed.contains(instr.callee());
+                        })) {
+            unit->checked = false;
+        }
+        if (!unit->checked) {
+            pending.emplace_back(unit);
+        }
+        fns.emplace_back(traverser::Function{unit->sig.name, unit->sig.args,
+                                             unit->sig.rets, {}});
+    }
+    std::optional<checks::TypeChecker> checker{};
+    try {
+        checker.emplace(fns, show_typecheck);
+    } catch (checks::CheckError e) {
+        return report(std::format("In function {}: {}", e.fname, e.what));
+    }
+    auto check_at = [&](std::size_t k) {
+        auto unit = pending[k];
+        try {
+            checker->check(*unit->fn);
+            unit->check_error.reset();
+        } catch (checks::CheckError e) {
+            unit->check_error =
+                std::format("In function {}: {}", e.fname, e.what);
+        }
+        unit->checked = true;
+    };
+    if (show_typecheck) {
+        for (std::size_t k = 0; k < pending.size(); ++k) {
+            check_at(k);
+        }
+    } else {
+        pool::shared().for_each(pending.size(), check_at);
+    }
+    for (auto unit : live) {
+        if (unit->check_error) {
+            return report(*unit->check_error);
+        }
+    }
+
+    // Each function gets its own object, named after its text, so only new
+    // text is compiled. Its C only declares the functions it calls.
+    std::string cflags{as_library ? "-O2 -fPIC"
+                                  : "-ggdb -fsanitize=address,leak"};
+    backend::c::Options opts{};
+    opts.library = as_library;
+    auto compile = [&](std::filesystem::path const &object,
+                       std::string const &code) {
+        auto c_file = std::filesystem::path(object).replace_extension(".c");
+        std::ofstream(c_file) << code;
+        bool ok = run_command(
+            std::format("gcc {} -c -x c {} -I{} -o {}", cflags,
+                        c_file.string(), (root / "core").string(),
+                        object.string()),
+            show_command);
+        std::filesystem::remove(c_file);
+        if (!ok) {
+            std::filesystem::remove(object);
+        }
+        return ok;
+    };
+    // Looked up by the whole text, so two texts never share an object
+    auto object_for = [&](std::string_view text, std::string_view prefix) {
+        auto id = object_names.try_emplace(std::string{text},
+                                           object_names.size())
+                      .first->second;
+        return objects / std::format("{}{}.o", prefix, id);
+    };
+    std::vector<std::filesystem::path> linked{};
+    std::vector<Unit *> stale{};
+    std::vector<std::filesystem::path> stale_objects{};
+    for (auto unit : live) {
+        linked.emplace_back(object_for(
+            input.view().substr(unit->sig.span.start,
+                                unit->sig.span.end - unit->sig.span.start),
+            ""));
+        if (!std::filesystem::exists(linked.back())) {
+            stale.emplace_back(unit);
+            stale_objects.emplace_back(linked.back());
+        }
+    }
+    std::vector<bool> compiled(stale.size(), false);
+    pool::shared().for_each(stale.size(), [&](std::size_t k) {
+        auto const &fn = *stale[k]->fn;
+        std::vector<traverser::Function> callees{};
+        std::unordered_set<symbols::Id> declared{};
+        for (auto const &instr : fn.body) {
+            auto callee = instr.callee();
+            if (instr.kind == ir::Instruction::Call &&
+                !builtins::find(callee) && declared.insert(callee).second) {
+                callees.emplace_back(
+                    traverser::Function{callee, {}, {}, {}});
+            }
+        }
+        compiled[k] = compile(stale_objects[k],
+                              backend::c::make_prelude(callees, opts) +
+                                  backend::c::make_function(fn, opts));
+    });
+    for (std::size_t k = 0; k < stale.size(); ++k) {
+        if (!compiled[k]) {
+            return report(std::format("Could not compile {}",
+                                      symbols::name(stale[k]->sig.name)));
+        }
+    }
+    auto entry = backend::c::make_prelude(fns, opts) +
+                 backend::c::make_entry(fns, opts);
+    linked.emplace_back(object_for(entry, "entry-"));
+    auto compiled_count = stale.size();
+    if (!std::filesystem::exists(linked.back())) {
+        if (!compile(linked.back(), entry)) {
+            return report("Could not compile the entry point");
+        }
+        ++compiled_count;
+    }
+
+    // Object lists can outgrow a command line, so gcc reads them from a file
+    auto list = objects / "objects";
+    {
+        std::ofstream out{list};
+        for (auto const &object : linked) {
+            out << object.string() << "\n";
+        }
+    }
+    if (!run_command(std::format("gcc {}{} @{} {} -o {} -lm", cflags,
+                                 as_library ? " -shared" : "", list.string(),
+                                 (root / "libcore.a").string(), out_file),
+                     show_command)) {
+        return report(std::format("Could not link {}", out_file));
+    }
+    if (as_library) {
+        auto header = std::filesystem::path(out_file).replace_extension(".h");
+        std::ofstream(header) << backend::c::make_header(fns);
+    }
+    std::chrono::duration<double> took =
+        std::chrono::steady_clock::now() - started;
+    std::println("Built {} in {:.0f} ms: {} traversed, {} checked, {} "
+                 "compiled",
+                 out_file, took.count() * 1e3, traversed, pending.size(),
+                 compiled_count);
+}
+
+void builder::Builder::watch(std::filesystem::path root,
+                             std::string out_file) {
+    if (pgo != Pgo::Off || backend != Backend::C) {
+        error("Watching needs the C backend without profiles");
+    }
+    // Objects from an earlier session may come from another compiler
+    auto objects = std::filesystem::absolute(out_file + ".watch");
+    std::filesystem::remove_all(objects);
+    std::filesystem::create_directories(objects);
+    // A save is built once the file has looked the same for one poll, so
+    // a write still in progress is never read
+    using Stamp = std::pair<std::filesystem::file_time_type, std::uintmax_t>;
+    std::optional<Stamp> built{};
+    std::optional<Stamp> last{};
+    while (true) {
+        std::error_code failed{};
+        Stamp stamp{std::filesystem::last_write_time(filename, failed), 0};
+        if (!failed) {
+            stamp.second = std::filesystem::file_size(filename, failed);
+        }
+        if (!failed && stamp == last && stamp != built) {
+            built = stamp;
+            rebuild(root, objects, out_file);
+            // Whoever reads the reports should see them as they come
+            std::fflush(stdout);
+        }
+        last = failed ? std::nullopt : std::optional<Stamp>{stamp};
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    }
 }
 
 void builder::Builder::error(std::string what) {
-    std::println("Err: {}", what);
-    std::exit(1);
+    throw BuildError{std::move(what)};
 }
 
 void builder::Builder::error(std::size_t start, std::size_t end,
                              std::string what) {
-    error(what);
+    throw BuildError{std::move(what), parser::Span{start, end}};
+}
+
+std::shared_ptr<builder::Memo::Entry const>
+builder::Memo::find(std::string const &path, ircache::Key key) {
+    std::scoped_lock guard{lock};
+    auto found = entries.find(path);
+    if (found == entries.end() || found->second->key != key) {
+        return nullptr;
+    }
+    return found->second;
 }
+
+void builder::Memo::store(std::string const &path,
+                          std::shared_ptr<Entry const> entry) {
+    std::scoped_lock guard{lock};
+    entries[path] = std::move(entry);
+}
+
 builder::Builder &builder::Builder::ir() {
     show_ir = !show_ir;
     return *this;
@@ -103,3 +817,35 @@ builder::Builder &builder::Builder::type() {
     show_typecheck = !show_typecheck;
     return *this;
 }
+builder::Builder &builder::Builder::llvm() {
+    backend = Backend::Llvm;
+    return *this;
+}
+builder::Builder &builder::Builder::assembly() {
+    backend = Backend::Asm;
+    return *this;
+}
+builder::Builder &builder::Builder::profile_generate() {
+    pgo = Pgo::Generate;
+    return *this;
+}
+builder::Builder &builder::Builder::profile_use() {
+    pgo = Pgo::Use;
+    return *this;
+}
+builder::Builder &builder::Builder::shared() {
+    as_library = !as_library;
+    return *this;
+}
+builder::Builder &builder::Builder::remember(Memo &memo) {
+    this->memo = &memo;
+    return *this;
+}
+builder::Builder &builder::Builder::cached() {
+    use_cache = !use_cache;
+    return *this;
+}
+builder::Builder &builder::Builder::streamed() {
+    streaming = !streaming;
+    return *this;
+}
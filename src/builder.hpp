@@ -1,35 +1,135 @@
 #pragma once
 
+#include "checks.hpp"
+#include "ircache.hpp"
+#include "make_c.hpp"
 #include "parser.hpp"
+#include "source.hpp"
 #include "traverser.hpp"
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <vector>
 namespace builder {
+// Why a build stopped, and where in the source when that is known
+struct BuildError {
+    std::string what;
+    std::optional<parser::Span> at{};
+};
+
+enum class Backend { C, Llvm, Asm };
+
+// Traversed and checked programs kept between builds in one process, by
+// source path. An entry is reused while the text of the source and the
+// kind of build stay the same. Safe to share between threads.
+class Memo {
+  public:
+    struct Entry {
+        ircache::Key key;
+        std::vector<traverser::Function> fns;
+        checks::Facts facts;
+    };
+
+    std::shared_ptr<Entry const> find(std::string const &path,
+                                      ircache::Key key);
+    void store(std::string const &path, std::shared_ptr<Entry const> entry);
+
+  private:
+    std::mutex lock{};
+    std::unordered_map<std::string, std::shared_ptr<Entry const>> entries{};
+};
+
+// Two-phase profile-guided builds: an instrumented build writes its counts
+// next to the program, and a later build reads them back
+enum class Pgo { Off, Generate, Use };
+
 class Builder {
-    std::string input{};
+    source::Source input{};
     std::string filename{"<anonymous>"};
     bool show_ir{false};
     bool show_gen{false};
     bool show_command{false};
     bool show_typecheck{false};
+    Backend backend{Backend::C};
+    Pgo pgo{Pgo::Off};
+    bool as_library{false};
+    // Traversed functions are saved next to the source and reused while it
+    // stays the same
+    bool use_cache{false};
+    // Only one function's grid, IR and generated code are held at a time
+    bool streaming{false};
+    checks::Facts facts{};
+    Memo *memo{nullptr};
+
+    // What watch() knows about one declaration between rebuilds
+    struct Unit {
+        parser::FnSig sig;
+        // Of the declaration's text, to find it again after an edit
+        std::size_t hash;
+        std::optional<traverser::Function> fn{};
+        std::optional<std::string> traverse_error{};
+        // Whether check_error still holds for the signatures it calls
+        bool checked{false};
+        std::optional<std::string> check_error{};
+    };
+    std::vector<Unit> units{};
+    // Argument and return types of each function as of the last check
+    std::unordered_map<symbols::Id, std::string> checked_sigs{};
+    // Number in the name of the object built from each declaration or
+    // entry point text
+    std::unordered_map<std::string, std::size_t> object_names{};
 
-    void error(std::size_t start, std::size_t end, std::string what);
-    void error(std::string what);
+    // Stop the build by throwing a BuildError
+    [[noreturn]] void error(std::size_t start, std::size_t end,
+                            std::string what);
+    [[noreturn]] void error(std::string what);
 
     std::vector<parser::TopLevel> parse();
+    std::vector<parser::FnSig> outline();
+    std::vector<traverser::Function> traverse_reachable();
     std::vector<traverser::Function> traverse();
-    std::string generate();
+    // Writes the C program to file a function at a time, returning the
+    // signatures of what it wrote
+    std::vector<traverser::Function>
+    stream(std::filesystem::path const &file,
+           backend::c::Options const &opts);
+    // Units for next, lexing only the part that differs from the current
+    // source and keeping what is known of the declarations around it
+    std::vector<Unit> relex(source::Source const &next);
+    // Brings out_file up to date with the source, reporting the first error
+    // instead of exiting on it
+    void rebuild(std::filesystem::path const &root,
+                 std::filesystem::path const &objects,
+                 std::string const &out_file);
+    std::string generate(std::vector<traverser::Function> const &fns,
+                         backend::c::Options const &opts);
 
   public:
     Builder(std::string input) : input(std::move(input)) {}
-    Builder(std::string input, std::string filename)
+    Builder(source::Source input, std::string filename)
         : input(std::move(input)), filename(std::move(filename)) {}
 
     void build(std::filesystem::path root, std::string out_file);
+    void run();
+    // Builds out_file, then again each time the source is saved, redoing
+    // only what the change affects. Runs until killed.
+    void watch(std::filesystem::path root, std::string out_file);
 
     Builder &ir();
     Builder &gen();
     Builder &cmd();
     Builder &type();
+    Builder &llvm();
+    Builder &assembly();
+    Builder &profile_generate();
+    Builder &profile_use();
+    Builder &shared();
+    Builder &cached();
+    // Reuses and adds to the programs in memo, which has to outlive the build
+    Builder &remember(Memo &memo);
+    Builder &streamed();
 };
 } // namespace builder
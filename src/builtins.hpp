@@ -0,0 +1,157 @@
+#pragma once
+
+#include "symbols.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string_view>
+
+// Every builtin the runtime provides, known at compile time. The interner
+// gives the first Ids to these names in table order, so finding the builtin
+// behind a symbol is an index into the table.
+namespace builtins {
+// Types in builtin signatures: the generics #a, #b and #c, bool, int or
+// float, and any stack
+enum class Slot : std::uint8_t { A, B, C, Bool, Num, Stack };
+
+struct Slots {
+    std::array<Slot, 3> at{};
+    std::uint8_t size{0};
+
+    constexpr Slots() = default;
+    constexpr Slots(std::initializer_list<Slot> slots) {
+        for (auto slot : slots) {
+            at[size++] = slot;
+        }
+    }
+
+    constexpr Slot const *begin() const { return at.data(); }
+    constexpr Slot const *end() const { return at.data() + size; }
+};
+
+enum Flags : std::uint8_t {
+    // Only changes the stack: no output, and the same arguments always give
+    // the same results
+    Pure = 1 << 0,
+    // Backends may open-code it once the operand types are proven
+    Inlinable = 1 << 1,
+    // Copies a value or builds a stack, which allocates beyond the stack
+    // nodes themselves
+    Allocates = 1 << 2,
+};
+
+struct Builtin {
+    std::string_view name;
+    // Builtin whose runtime function does the work, which for aliases is
+    // the builtin they spell differently
+    std::string_view runtime;
+    Slots args;
+    Slots rets;
+    // Takes the whole stack instead of args
+    bool takes_all;
+    std::uint8_t flags;
+};
+
+// clang-format off
+inline constexpr auto table = [] {
+    using enum Slot;
+    return std::array{
+        Builtin{"dup",  "dup",  {A}, {A, A}, false, Pure | Allocates},
+        Builtin{"⇈",    "dup",  {A}, {A, A}, false, Pure | Allocates},
+
+        Builtin{"=",    "=",    {A, B}, {Bool}, false, Pure | Inlinable},
+        Builtin{"!=",   "!=",   {A, B}, {Bool}, false, Pure | Inlinable},
+        Builtin{"≠",    "!=",   {A, B}, {Bool}, false, Pure | Inlinable},
+        Builtin{"<",    "<",    {Num, Num}, {Bool}, false, Pure | Inlinable},
+        Builtin{">",    ">",    {Num, Num}, {Bool}, false, Pure | Inlinable},
+        Builtin{">=",   ">=",   {Num, Num}, {Bool}, false, Pure | Inlinable},
+        Builtin{"≥",    ">=",   {Num, Num}, {Bool}, false, Pure | Inlinable},
+        Builtin{"<=",   "<=",   {Num, Num}, {Bool}, false, Pure | Inlinable},
+        Builtin{"≤",    "<=",   {Num, Num}, {Bool}, false, Pure | Inlinable},
+
+        Builtin{"swp",  "swp",  {A, B}, {B, A}, false, Pure},
+        Builtin{"↕",    "swp",  {A, B}, {B, A}, false, Pure},
+
+        Builtin{"rot",  "rot",  {A, B, C}, {C, A, B}, false, Pure},
+        Builtin{"↻",    "rot",  {A, B, C}, {C, A, B}, false, Pure},
+        Builtin{"rot-", "rot-", {A, B, C}, {B, C, A}, false, Pure},
+        Builtin{"↷",    "rot-", {A, B, C}, {B, C, A}, false, Pure},
+
+        Builtin{"dbg",  "dbg",  {}, {}, false, 0},
+        Builtin{"print", "print", {A}, {}, false, 0},
+
+        Builtin{"+",    "+",    {Num, Num}, {Num}, false, Pure | Inlinable},
+        Builtin{"-",    "-",    {Num, Num}, {Num}, false, Pure | Inlinable},
+        Builtin{"*",    "*",    {Num, Num}, {Num}, false, Pure | Inlinable},
+        Builtin{"/",    "/",    {Num, Num}, {Num}, false, Pure | Inlinable},
+        Builtin{"%",    "%",    {Num, Num}, {Num}, false, Pure},
+
+        Builtin{"box",  "box",  {}, {Stack}, true, Pure | Allocates},
+        Builtin{"▭",    "box",  {}, {Stack}, true, Pure | Allocates},
+
+        Builtin{"pop",  "pop",  {A}, {}, false, Pure},
+        Builtin{"◌",    "pop",  {A}, {}, false, Pure},
+
+        Builtin{"ins",  "ins",  {A, Stack}, {Stack}, false, Pure},
+        Builtin{"⤓",    "ins",  {A, Stack}, {Stack}, false, Pure},
+
+        Builtin{"fst!", "fst!", {Stack}, {A, Stack}, false, Pure},
+        Builtin{"⊢!",   "fst!", {Stack}, {A, Stack}, false, Pure},
+        Builtin{"lst!", "lst!", {Stack}, {A, Stack}, false, Pure},
+        Builtin{"⊣!",   "lst!", {Stack}, {A, Stack}, false, Pure},
+        Builtin{"fst",  "fst",  {Stack}, {A, Stack}, false, Pure | Allocates},
+        Builtin{"⊢",    "fst",  {Stack}, {A, Stack}, false, Pure | Allocates},
+        Builtin{"lst",  "lst",  {Stack}, {A, Stack}, false, Pure | Allocates},
+        Builtin{"⊣",    "lst",  {Stack}, {A, Stack}, false, Pure | Allocates},
+    };
+}();
+// clang-format on
+
+// Position of name in the table. Only meant for constant evaluation, where
+// a missing name fails the build.
+constexpr std::size_t index_of(std::string_view name) {
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        if (table[i].name == name) {
+            return i;
+        }
+    }
+    throw std::logic_error("Unknown builtin");
+}
+
+// Table position of the builtin each one runs as
+inline constexpr auto runtimes = [] {
+    std::array<std::uint8_t, table.size()> out{};
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        out[i] = index_of(table[i].runtime);
+    }
+    return out;
+}();
+
+// Ids are handed out by name, so two entries can't share one
+static_assert([] {
+    for (std::size_t i = 0; i < table.size(); ++i) {
+        if (index_of(table[i].name) != i) {
+            return false;
+        }
+    }
+    return true;
+}());
+
+inline Builtin const *find(symbols::Id id) {
+    auto i = symbols::index(id);
+    return i < table.size() ? &table[i] : nullptr;
+}
+
+constexpr symbols::Id id(Builtin const &builtin) {
+    return symbols::Id{static_cast<std::uint32_t>(&builtin - table.data())};
+}
+
+// The symbol a call to id ends up in: the runtime function behind a
+// builtin, or id itself
+inline symbols::Id target(symbols::Id id) {
+    auto i = symbols::index(id);
+    return i < table.size() ? symbols::Id{runtimes[i]} : id;
+}
+} // namespace builtins
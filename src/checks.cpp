@@ -1,81 +1,350 @@
 #include "checks.hpp"
+#include "builtins.hpp"
 #include "ir.hpp"
 #include "parser.hpp"
+#include "pool.hpp"
 #include <algorithm>
+#include <array>
 #include <cassert>
-#include <functional>
 #include <print>
 
-void print_stk(std::vector<checks::Type> const &stk) {
-    if (stk.empty()) {
-        std::println("[]");
+static std::uint64_t mix(std::uint64_t h, std::uint64_t v) {
+    return (h ^ v) * 0x100000001B3ull;
+}
+
+std::size_t checks::TypeHash::operator()(Type const &t) const {
+    std::uint64_t h = 0xCBF29CE484222325ull;
+    h = mix(h, t.kind);
+    h = mix(h, t.stack);
+    h = mix(h, symbols::index(t.tag));
+    for (auto id : t.elems) {
+        h = mix(h, static_cast<std::uint32_t>(id));
+    }
+    return h;
+}
+
+std::size_t
+checks::TypeIdsHash::operator()(std::vector<TypeId> const &ids) const {
+    std::uint64_t h = 0xCBF29CE484222325ull;
+    for (auto id : ids) {
+        h = mix(h, static_cast<std::uint32_t>(id));
+    }
+    return h;
+}
+
+checks::TypeArena::TypeArena(TypeArena const *parent,
+                             std::pmr::memory_resource *memory)
+    : parent(parent), base(parent ? parent->size() : 0), types(memory),
+      ids(memory), matching(memory), collapsed(memory) {
+    // Scalars come first, so their handles are their kinds
+    if (!parent) {
+        for (auto kind : {Type::Int, Type::Float, Type::Bool, Type::Char,
+                          Type::String}) {
+            intern(Type{kind});
+        }
+    }
+}
+
+std::optional<checks::TypeId> checks::TypeArena::find(Type const &t) const {
+    if (parent) {
+        if (auto id = parent->find(t)) {
+            return id;
+        }
+    }
+    if (auto it = ids.find(t); it != ids.end()) {
+        return it->second;
+    }
+    return {};
+}
+
+checks::TypeId checks::TypeArena::intern(Type t) {
+    if (auto id = find(t)) {
+        return *id;
+    }
+    TypeId id{static_cast<std::uint32_t>(size())};
+    ids.emplace(t, id);
+    types.emplace_back(std::move(t));
+    return id;
+}
+
+checks::Type const &checks::TypeArena::operator[](TypeId id) const {
+    auto i = static_cast<std::size_t>(id);
+    return i < base ? (*parent)[id] : types[i - base];
+}
+
+checks::TypeId checks::TypeArena::generic(std::string_view name) {
+    return intern(Type{Type::Generic, Type::Exact, symbols::intern(name)});
+}
+
+checks::TypeId checks::TypeArena::sum(std::vector<TypeId> members) {
+    std::vector<TypeId> flat{};
+    for (auto m : members) {
+        auto const &t = (*this)[m];
+        if (t.kind == Type::Union) {
+            flat.insert(flat.end(), t.elems.begin(), t.elems.end());
+        } else {
+            flat.emplace_back(m);
+        }
+    }
+    std::sort(flat.begin(), flat.end());
+    flat.erase(std::unique(flat.begin(), flat.end()), flat.end());
+    if (flat.size() == 1) {
+        return flat.front();
+    }
+    return intern(Type{Type::Union, Type::Exact, {}, std::move(flat)});
+}
+
+checks::TypeId checks::TypeArena::many(TypeId elem) {
+    return intern(Type{Type::Many, Type::Exact, {}, {elem}});
+}
+
+checks::TypeId checks::TypeArena::stack_of(TypeId elem) {
+    return intern(Type{Type::Stack, Type::Repeated, {}, {elem}});
+}
+
+checks::TypeId checks::TypeArena::stack_any() {
+    return intern(Type{Type::Stack, Type::Unknown});
+}
+
+bool checks::TypeArena::matches(TypeId got, TypeId expected) {
+    if (got == expected) {
+        return true;
+    }
+    auto key = static_cast<std::uint64_t>(got) << 32 |
+               static_cast<std::uint32_t>(expected);
+    if (auto it = matching.find(key); it != matching.end()) {
+        return it->second;
+    }
+    auto const &g = (*this)[got];
+    auto const &e = (*this)[expected];
+    auto all = [this](std::vector<TypeId> const &gs, TypeId e) {
+        return std::all_of(gs.begin(), gs.end(),
+                           [&](TypeId g) { return matches(g, e); });
+    };
+    bool result;
+    if (g.kind == Type::Generic || e.kind == Type::Generic) {
+        result = true;
+    } else if (g.kind == Type::Many) {
+        result = matches(g.elems.front(), expected);
+    } else if (e.kind == Type::Many) {
+        result = matches(got, e.elems.front());
+    } else if (e.kind == Type::Union) {
+        result = std::any_of(e.elems.begin(), e.elems.end(),
+                             [&](TypeId m) { return matches(got, m); });
+    } else if (g.kind == Type::Union) {
+        result = std::any_of(g.elems.begin(), g.elems.end(),
+                             [&](TypeId m) { return matches(m, expected); });
+    } else if (g.kind == Type::Stack && e.kind == Type::Stack) {
+        if (g.stack == Type::Unknown || e.stack == Type::Unknown) {
+            result = true;
+        } else if (e.stack == Type::Repeated) {
+            // Two repeated stacks match whatever their elements are
+            result = g.stack == Type::Repeated || all(g.elems, e.elems.front());
+        } else if (g.stack == Type::Repeated) {
+            result = std::all_of(e.elems.begin(), e.elems.end(), [&](TypeId m) {
+                return matches(g.elems.front(), m);
+            });
+        } else {
+            result = g.elems.size() == e.elems.size() &&
+                     std::equal(g.elems.begin(), g.elems.end(),
+                                e.elems.begin(), [&](TypeId a, TypeId b) {
+                                    return matches(a, b);
+                                });
+        }
     } else {
-        std::string s{stk.front().show()};
-        for (auto elem = stk.begin() + 1; elem != stk.end(); ++elem) {
-            s += ", " + elem->show();
+        result = g.kind == e.kind;
+    }
+    matching.emplace(key, result);
+    return result;
+}
+
+checks::TypeId checks::TypeArena::collapse(std::vector<TypeId> const &types) {
+    if (auto it = collapsed.find(types); it != collapsed.end()) {
+        return it->second;
+    }
+    std::vector<TypeId> elems{};
+    std::vector<TypeId> pending(types.rbegin(), types.rend());
+    while (!pending.empty()) {
+        auto id = pending.back();
+        pending.pop_back();
+        auto const &t = (*this)[id];
+        if (t.kind == Type::Union || t.kind == Type::Many) {
+            pending.insert(pending.end(), t.elems.rbegin(), t.elems.rend());
+        } else {
+            elems.emplace_back(id);
+        }
+    }
+
+    std::vector<TypeId> uniq{};
+    for (auto t : elems) {
+        if (std::none_of(uniq.begin(), uniq.end(), [&](TypeId u) {
+                return matches(t, u) && matches(u, t);
+            })) {
+            uniq.push_back(t);
         }
-        std::println("[{}]", s);
     }
+
+    auto result = uniq.size() == 1 ? uniq.front() : sum(std::move(uniq));
+    collapsed.emplace(types, result);
+    return result;
 }
 
-checks::Type generic(std::string const x) {
-    return checks::Type{checks::Type::Generic, "#" + x};
+std::string checks::TypeArena::show(TypeId id) const {
+    auto const &t = (*this)[id];
+    auto join = [this](std::vector<TypeId> const &ids, std::string_view sep) {
+        std::string out{};
+        for (auto elem = ids.begin(); elem != ids.end(); ++elem) {
+            if (elem != ids.begin()) {
+                out += sep;
+            }
+            out += show(*elem);
+        }
+        return out;
+    };
+    switch (t.kind) {
+    case Type::Int:
+        return "int";
+    case Type::Float:
+        return "float";
+    case Type::Bool:
+        return "bool";
+    case Type::Char:
+        return "char";
+    case Type::String:
+        return "string";
+    case Type::Generic:
+        return symbols::name(t.tag);
+    case Type::Union:
+        return join(t.elems, " | ");
+    case Type::Many:
+        return "many(" + show(t.elems.front()) + ")";
+    case Type::Stack:
+        switch (t.stack) {
+        case Type::Exact:
+            return "[" + join(t.elems, ", ") + "]";
+        case Type::Repeated:
+            return "[..." + show(t.elems.front()) + "]";
+        case Type::Unknown:
+            return "[?]";
+        }
+    }
+    return "";
 }
 
-template <typename... Ts> checks::Type tsum(Ts... types) {
-    return checks::Type{checks::Type::Union,
-                        std::vector<checks::Type>{types...}};
+checks::TypeStack::TypeStack(std::vector<TypeId> const &types,
+                             std::pmr::memory_resource *memory)
+    : memory(memory) {
+    for (auto t : types) {
+        push(t);
+    }
 }
 
-checks::Type tsum(std::vector<checks::Type> types) {
-    return checks::Type{checks::Type::Union, std::move(types)};
+checks::TypeStack &checks::TypeStack::operator=(TypeStack other) {
+    // The old nodes leave through other's destructor
+    std::swap(head, other.head);
+    std::swap(memory, other.memory);
+    return *this;
 }
 
-checks::Type tstack_many(checks::Type const t) {
-    return checks::Type{checks::Type::Stack,
-                        checks::StackType{checks::StackType::Many,
-                                          std::make_shared<checks::Type>(t)}};
+checks::TypeStack::~TypeStack() { clear(); }
+
+void checks::TypeStack::push(TypeId t) {
+    head = std::allocate_shared<Node const>(
+        std::pmr::polymorphic_allocator<Node>{memory},
+        Node{t, size() + 1, std::move(head)});
 }
 
-checks::Type many(checks::Type const t) {
-    return checks::Type{checks::Type::Many, std::make_shared<checks::Type>(t)};
+void checks::TypeStack::pop() { head = head->below; }
+
+void checks::TypeStack::clear() {
+    // Frees unshared nodes one at a time, as releasing a long chain through
+    // the nodes' own destructors would recurse once per node
+    while (head && head.use_count() == 1) {
+        auto below = head->below;
+        head = std::move(below);
+    }
+    head.reset();
 }
 
-static const checks::Type tbool = checks::Type{checks::Type::Bool, {}};
-static const checks::Type tint = checks::Type{checks::Type::Int, {}};
-static const checks::Type tfloat = checks::Type{checks::Type::Float, {}};
-static const checks::Type tstring = checks::Type{checks::Type::String, {}};
-static const checks::Type tchar = checks::Type{checks::Type::Char, {}};
+checks::TypeStack checks::TypeStack::drop(std::size_t count) const {
+    TypeStack rest{*this};
+    for (; count > 0; --count) {
+        rest.pop();
+    }
+    return rest;
+}
+
+void checks::TypeStack::replace(TypeId from, TypeId to) {
+    std::vector<TypeId> above{};
+    std::size_t rebuilt = 0;
+    for (auto t : *this) {
+        above.emplace_back(t);
+        if (t == from) {
+            rebuilt = above.size();
+        }
+    }
+    *this = drop(rebuilt);
+    for (auto t = above.rend() - rebuilt; t != above.rend(); ++t) {
+        push(*t == from ? to : *t);
+    }
+}
+
+std::vector<checks::TypeId> checks::TypeStack::types() const {
+    std::vector<TypeId> out(size());
+    auto slot = out.rbegin();
+    for (auto t : *this) {
+        *slot++ = t;
+    }
+    return out;
+}
+
+bool checks::TypeStack::operator==(TypeStack const &other) const {
+    if (size() != other.size()) {
+        return false;
+    }
+    for (auto a = begin(), b = other.begin(); !a.shares(b); ++a, ++b) {
+        if (*a != *b) {
+            return false;
+        }
+    }
+    return true;
+}
 
-static const checks::Type tstack_any = checks::Type{
-    checks::Type::Stack, checks::StackType{checks::StackType::Unknown, {}}};
+void print_stk(checks::TypeArena const &arena, checks::TypeStack const &stack) {
+    auto stk = stack.types();
+    if (stk.empty()) {
+        std::println("[]");
+    } else {
+        std::string s{arena.show(stk.front())};
+        for (auto elem = stk.begin() + 1; elem != stk.end(); ++elem) {
+            s += ", " + arena.show(*elem);
+        }
+        std::println("[{}]", s);
+    }
+}
 
-checks::Type decl2type(parser::TypeSig decl, std::string fname) {
+checks::TypeId decl2type(checks::TypeArena &arena, parser::TypeSig decl,
+                         std::string const &fname) {
     if (decl.is_stack) {
         decl.is_stack = false;
-        auto type = decl2type(decl, fname);
-        auto stk = checks::Type{
-            checks::Type::Stack,
-            checks::StackType{checks::StackType::Many,
-                              std::make_shared<checks::Type>(type)}};
-        return stk;
+        return arena.stack_of(decl2type(arena, decl, fname));
     }
 
     if (decl.name == "int") {
-        return {checks::Type::Int, {}};
+        return arena.scalar(checks::Type::Int);
     } else if (decl.name == "float") {
-        return {checks::Type::Float, {}};
+        return arena.scalar(checks::Type::Float);
     } else if (decl.name == "bool") {
-        return {checks::Type::Bool, {}};
+        return arena.scalar(checks::Type::Bool);
     } else if (decl.name == "char") {
-        return {checks::Type::Char, {}};
+        return arena.scalar(checks::Type::Char);
     } else if (decl.name == "string") {
-        return {checks::Type::String, {}};
+        return arena.scalar(checks::Type::String);
     } else if (decl.name == "stack") {
-        return tstack_any;
+        return arena.stack_any();
     } else {
         if (decl.name.starts_with("#")) {
-            return {checks::Type::Generic, decl.name};
+            return arena.generic(decl.name);
         } else {
             throw checks::CheckError(
                 "Type '" + decl.name + "' is not recognized.", fname);
@@ -85,167 +354,85 @@ checks::Type decl2type(parser::TypeSig decl, std::string fname) {
 
 void checks::TypeChecker::collect_sigs() {
     for (auto &decl : fns) {
+        auto const &fname = symbols::name(decl.name);
         Function func{};
         func.args.reserve(decl.args.args.size());
         if (decl.args.kind == parser::Argument::Ellipses) {
             func.is_ellipses = true;
         }
         for (auto &[name, type] : decl.args.args) {
-            func.args.emplace_back(decl2type(type, decl.name));
+            func.args.emplace_back(decl2type(types, type, fname));
         }
         if (decl.rets.rest) {
-            func.returns_many = decl2type(*decl.rets.rest, decl.name);
+            func.returns_many = decl2type(types, *decl.rets.rest, fname);
         }
         func.rets.reserve(decl.rets.args.size());
         for (auto &type : decl.rets.args) {
-            func.rets.emplace_back(decl2type(type, decl.name));
+            func.rets.emplace_back(decl2type(types, type, fname));
         }
-        sigs.emplace(decl.name, func);
-        std::string args{};
-        if (!func.args.empty()) {
-            args += func.args.front().show();
-            for (auto elem = func.args.begin() + 1; elem != func.args.end();
+        if (show_typechecks) {
+            std::string args{};
+            for (auto elem = func.args.begin(); elem != func.args.end();
                  ++elem) {
-                args += ", " + elem->show();
+                args += (elem == func.args.begin() ? "" : ", ") +
+                        types.show(*elem);
             }
-        }
-        std::string rets{};
-        if (!func.rets.empty()) {
-            rets += func.rets.front().show();
-            for (auto elem = func.rets.begin() + 1; elem != func.rets.end();
+            std::string rets{};
+            for (auto elem = func.rets.begin(); elem != func.rets.end();
                  ++elem) {
-                rets += ", " + elem->show();
+                rets += (elem == func.rets.begin() ? "" : ", ") +
+                        types.show(*elem);
             }
-        }
-        std::string ellipses{func.is_ellipses ? ", ..." : ""};
-        std::string retmany{
-            func.returns_many ? ", ..." + func.returns_many->show() : ""};
-        if (show_typechecks) {
-            std::println("fn {} :: ({}{}) -> ({}{})", decl.name, args, ellipses,
+            std::string ellipses{func.is_ellipses ? ", ..." : ""};
+            std::string retmany{func.returns_many
+                                    ? ", ..." + types.show(*func.returns_many)
+                                    : ""};
+            std::println("fn {} :: ({}{}) -> ({}{})", fname, args, ellipses,
                          rets, retmany);
         }
+        sigs[decl.name] = std::move(func);
     }
 }
 
-bool is_matching(checks::Type got, checks::Type expected) {
-    if (got.kind == checks::Type::Generic ||
-        expected.kind == checks::Type::Generic) {
-        return true;
-    }
-    if (got.kind == checks::Type::Many) {
-        return is_matching(*std::get<3>(got.val), expected);
-    }
-    if (expected.kind == checks::Type::Many) {
-        return is_matching(got, *std::get<3>(expected.val));
-    }
-    if (expected.kind == checks::Type::Union) {
-        for (auto &t : std::get<2>(expected.val)) {
-            if (is_matching(got, t)) {
-                return true;
-            }
-        }
-        return false;
-    }
-    if (got.kind == checks::Type::Union) {
-        for (auto &t : std::get<2>(got.val)) {
-            if (is_matching(t, expected)) {
-                return true;
-            }
-        }
-        return false;
-    }
-    if (got.kind == checks::Type::Stack &&
-        expected.kind == checks::Type::Stack) {
-        auto stk_got = std::get<checks::StackType>(got.val);
-        auto stk_expected = std::get<checks::StackType>(expected.val);
-        if (stk_got.kind == checks::StackType::Unknown ||
-            stk_expected.kind == checks::StackType::Unknown) {
-            return true;
-        }
-        if (stk_expected.kind == checks::StackType::Many) {
-            checks::Type expect_all = *std::get<1>(stk_expected.val);
-            if (stk_got.kind == checks::StackType::Many) {
-                checks::Type got_all = *std::get<1>(stk_expected.val);
-                return is_matching(got_all, expect_all);
-            } else {
-                auto got_exact = std::get<0>(stk_got.val);
-                for (auto &elem : got_exact) {
-                    if (!is_matching(elem, expect_all)) {
-                        return false;
-                    }
-                }
-                return true;
-            }
-        } else {
-            auto exp_exact = std::get<0>(stk_expected.val);
-            if (stk_got.kind == checks::StackType::Many) {
-                checks::Type got_all = *std::get<1>(stk_expected.val);
-                for (auto &elem : exp_exact) {
-                    if (!is_matching(got_all, elem)) {
-                        return false;
-                    }
-                }
-                return true;
-            } else {
-                auto got_exact = std::get<0>(stk_got.val);
-                if (got_exact.size() != exp_exact.size())
-                    return false;
-                for (std::size_t i = 0; i < got_exact.size(); ++i) {
-                    if (!is_matching(got_exact[i], exp_exact[i])) {
-                        return false;
-                    }
-                }
-                return true;
+void checks::TypeChecker::try_apply(TypeArena &arena, TypeStack &stack,
+                                    Function const &sig,
+                                    std::string const &caller,
+                                    std::string const &callee) const {
+    // Generics of the signature bound to the types they were called with
+    std::vector<std::pair<TypeId, TypeId>> bound{};
+    auto resolve = [&bound](TypeId t) {
+        for (auto [generic, type] : bound) {
+            if (generic == t) {
+                return type;
             }
         }
-    }
-    return got.kind == expected.kind;
-}
-
-void checks::TypeChecker::try_apply(std::vector<Type> &stack, Function sig,
-                                    std::string caller, std::string callee) {
-    for (auto const &expect : sig.args) {
+        return t;
+    };
+    for (auto arg : sig.args) {
+        auto expect = resolve(arg);
         if (stack.empty()) {
             throw CheckError{std::format("'{}' expected '{}', got nothing",
-                                         callee, expect.show()),
+                                         callee, arena.show(expect)),
                              caller};
         }
-        auto top = stack.back();
-        if (top.kind != Type::Many) {
-            stack.pop_back();
+        auto top = stack.top();
+        auto top_kind = arena[top].kind;
+        if (top_kind != Type::Many) {
+            stack.pop();
         }
-        if (top.kind == Type::Generic) {
-            auto tag = std::get<std::string>(top.val);
-            for (auto &el : stack) {
-                if (el.kind == Type::Generic &&
-                    std::get<std::string>(el.val) == tag) {
-                    el = expect;
-                }
-            }
+        if (top_kind == Type::Generic) {
+            stack.replace(top, expect);
             continue;
         }
 
-        if (expect.kind == Type::Generic) {
-            auto tag = std::get<std::string>(expect.val);
-            for (auto &el : sig.args) {
-                if (el.kind == Type::Generic &&
-                    std::get<std::string>(el.val) == tag) {
-                    el = top;
-                }
-            }
-
-            for (auto &el : sig.rets) {
-                if (el.kind == Type::Generic &&
-                    std::get<std::string>(el.val) == tag) {
-                    el = top;
-                }
-            }
+        if (arena[expect].kind == Type::Generic) {
+            bound.emplace_back(expect, top);
             continue;
         }
 
-        if (!is_matching(top, expect)) {
+        if (!arena.matches(top, expect)) {
             throw CheckError{std::format("'{}' expected '{}', got '{}'", callee,
-                                         expect.show(), top.show()),
+                                         arena.show(expect), arena.show(top)),
                              caller};
         }
     }
@@ -254,106 +441,72 @@ void checks::TypeChecker::try_apply(std::vector<Type> &stack, Function sig,
         stack.clear();
     }
 
-    stack.insert(stack.end(), sig.rets.begin(), sig.rets.end());
+    for (auto ret : sig.rets) {
+        stack.push(resolve(ret));
+    }
 
     if (sig.returns_many) {
-        stack.emplace_back(tstack_many(*sig.returns_many));
+        stack.push(arena.stack_of(*sig.returns_many));
     }
 }
 
-struct State {
-    std::size_t ip;
-    std::vector<checks::Type> stack;
-};
+// Joins at a block entry that still change the stack after this many
+// rounds are widened
+static constexpr unsigned widen_after = 4;
 
-auto get_label(std::vector<ir::Instruction> const &irs,
-               std::string const &label) {
-    return std::find_if(irs.begin(), irs.end(), [&label](auto &&ir) {
-        return ir.kind == ir::Instruction::Label &&
-               std::get<std::string>(ir.value) == label;
-    });
-}
-
-checks::Type union_collapse(std::vector<checks::Type> const &types) {
-    std::vector<checks::Type> elems{};
-
-    std::function<void(checks::Type const &)> collect =
-        [&elems, &collect](checks::Type const &t) {
-            if (t.kind == checks::Type::Union) {
-                for (auto &u : std::get<2>(t.val)) {
-                    collect(u);
-                }
-            } else if (t.kind == checks::Type::Many) {
-                collect(*std::get<3>(t.val));
-            } else {
-                elems.emplace_back(t);
-            }
-        };
-
-    for (auto &t : types)
-        collect(t);
-
-    std::vector<checks::Type> uniq;
-    for (auto &t : elems) {
-        if (std::none_of(uniq.begin(), uniq.end(), [&](auto &u) {
-                return is_matching(t, u) && is_matching(u, t);
-            })) {
-            uniq.push_back(t);
-        }
+// Gives up on the shape of a stack that keeps changing: it becomes any
+// number of the types seen in it. From there a join can only add types, of
+// which a function has finitely many.
+void widen(checks::TypeArena &arena, checks::TypeStack &stack) {
+    if (!stack.empty()) {
+        auto many = arena.many(arena.collapse(stack.types()));
+        stack.clear();
+        stack.push(many);
     }
-
-    if (uniq.size() == 1)
-        return uniq.front();
-
-    return tsum(uniq);
 }
 
-bool checks::TypeChecker::unify(std::vector<checks::Type> &prev,
-                                std::vector<checks::Type> &current) {
-    auto p = prev.rbegin();
-    auto c = current.rbegin();
+bool checks::TypeChecker::unify(TypeArena &arena, TypeStack &prev,
+                                TypeStack const &current) const {
+    auto p = prev.begin();
+    auto c = current.begin();
 
-    std::vector<checks::Type> suffix{};
+    // Joined types, top first, down to where both stacks share their nodes
+    std::vector<TypeId> suffix{};
 
-    for (; p != prev.rend() && c != current.rend(); ++p, ++c) {
-        if (is_matching(*c, *p)) {
+    for (; p != prev.end() && c != current.end() && !p.shares(c); ++p, ++c) {
+        if (arena.matches(*c, *p)) {
             suffix.emplace_back(*p);
         } else {
-            suffix.emplace_back(tsum(*p, *c));
+            suffix.emplace_back(arena.sum({*p, *c}));
         }
     }
 
-    std::vector<checks::Type> result{};
+    TypeStack result{prev.resource()};
 
-    if (p == prev.rend() && c == current.rend()) {
-        result = suffix;
-        std::reverse(result.begin(), result.end());
-        // } else if (p == prev.rend() || c == current.rend()) {
+    if (p.shares(c)) {
+        result = prev.drop(suffix.size());
+        for (auto t = suffix.rbegin(); t != suffix.rend(); ++t) {
+            result.push(*t);
+        }
     } else {
-        std::vector<checks::Type> extras{};
-        for (; p != prev.rend(); ++p) {
+        std::vector<TypeId> extras{};
+        for (; p != prev.end(); ++p) {
             extras.emplace_back(*p);
         }
 
-        for (; c != current.rend(); ++c) {
+        for (; c != current.end(); ++c) {
             extras.emplace_back(*c);
         }
 
         extras.insert(extras.end(), suffix.begin(), suffix.end());
 
-        checks::Type collapsed = union_collapse(extras);
-
-        result.emplace_back(many(collapsed));
+        result.push(arena.many(arena.collapse(extras)));
     }
 
-    // print_stk(result);
-    // print_stk(prev);
-    // std::println("- - - -");
-
     if (result == prev) {
         if (show_typechecks) {
             std::println("Converged:");
-            print_stk(prev);
+            print_stk(arena, prev);
         }
         return false;
     }
@@ -362,314 +515,414 @@ bool checks::TypeChecker::unify(std::vector<checks::Type> &prev,
     return true;
 }
 
-void checks::TypeChecker::verify(traverser::Function fn) {
-    auto expected = sigs.at(fn.name);
-    std::vector<Type> initial;
+// Kinds of the values on top of a stack, top first. Entries past the end
+// and empty ones are unknown.
+using Kinds = std::vector<std::optional<checks::Type::Kind>>;
+
+// Keeps what both paths agree on, and says whether into changed
+bool meet(Kinds &into, Kinds const &other) {
+    bool changed = other.size() < into.size();
+    into.resize(std::min(into.size(), other.size()));
+    for (std::size_t i = 0; i < into.size(); ++i) {
+        if (into[i] && into[i] != other[i]) {
+            into[i] = {};
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+std::optional<checks::Type::Kind> kind_at(Kinds const &kinds,
+                                          std::size_t depth) {
+    return depth < kinds.size() ? kinds[depth] : std::nullopt;
+}
+
+void drop(Kinds &kinds, std::size_t n) {
+    kinds.erase(kinds.begin(),
+                kinds.begin() + static_cast<std::ptrdiff_t>(
+                                    std::min(n, kinds.size())));
+}
+
+// What the runtime leaves for a number made from a and b, which is an int
+// only when both are
+std::optional<checks::Type::Kind>
+number_of(std::optional<checks::Type::Kind> a,
+          std::optional<checks::Type::Kind> b) {
+    using enum checks::Type::Kind;
+    auto numeric = [](auto k) { return k == Int || k == Float; };
+    if (!numeric(a) || !numeric(b))
+        return {};
+    return a == Int && b == Int ? Int : Float;
+}
+
+// Follows kinds through a builtin by its signature, where a generic result
+// has the kind of the argument it names
+void apply_builtin(Kinds &kinds, builtins::Builtin const &builtin) {
+    using enum builtins::Slot;
+    if (builtin.takes_all) {
+        kinds.clear();
+    }
+    Kinds args(builtin.args.size);
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        args[i] = kind_at(kinds, i);
+    }
+    Kinds rets{};
+    for (auto slot : builtin.rets) {
+        switch (slot) {
+        case A:
+        case B:
+        case C: {
+            auto arg = std::ranges::find(builtin.args, slot);
+            rets.emplace_back(arg == builtin.args.end()
+                                  ? std::nullopt
+                                  : args[arg - builtin.args.begin()]);
+            break;
+        }
+        case Bool:
+            rets.emplace_back(checks::Type::Bool);
+            break;
+        case Num:
+            rets.emplace_back(number_of(kind_at(args, 0), kind_at(args, 1)));
+            break;
+        case Stack:
+            rets.emplace_back();
+            break;
+        }
+    }
+    drop(kinds, args.size());
+    kinds.insert(kinds.begin(), rets.begin(), rets.end());
+}
+
+std::vector<checks::Fact>
+checks::TypeChecker::verify(traverser::Function const &fn) const {
+    auto const &expected = **sigs.find(fn.name);
+    auto const &fname = symbols::name(fn.name);
+    auto const &body = fn.body;
+    // Everything built while checking this function but the facts lives
+    // here, and is released in one go
+    std::pmr::monotonic_buffer_resource scratch{};
+    // Unions made while checking this function stay local to it
+    TypeArena arena{&types, &scratch};
+
+    // Blocks start at the entry, at labels and after jumps. Block state is
+    // indexed by the instruction a block starts at.
+    std::pmr::vector<bool> starts_block(body.size() + 1, false, &scratch);
+    starts_block[0] = true;
+    for (std::size_t ip = 0; ip < body.size(); ++ip) {
+        switch (body[ip].kind) {
+        case ir::Instruction::Label:
+            starts_block[ip] = true;
+            break;
+        case ir::Instruction::JumpTrue:
+        case ir::Instruction::Goto:
+        case ir::Instruction::Exit:
+            starts_block[ip + 1] = true;
+            break;
+        default:
+            break;
+        }
+    }
+    auto label_at = [&](ir::Instruction jump) {
+        auto ip = body.ip_of(jump.label());
+        if (!ip) {
+            throw CheckError("Attempted to jump to invalid label '" +
+                                 body.label_name(jump.label()) + "'",
+                             fname);
+        }
+        return *ip;
+    };
+
+    // One joined stack per block entry, and the blocks whose entry changed
+    // since they were last checked. Jump targets go on top, so they are
+    // checked before the fallthrough.
+    std::pmr::vector<std::optional<TypeStack>> entries(body.size(), &scratch);
+    std::pmr::vector<unsigned> changes(body.size(), 0, &scratch);
+    std::pmr::vector<bool> pending(body.size(), false, &scratch);
+    std::pmr::vector<std::size_t> work{&scratch};
+    auto flow = [&](std::size_t ip, TypeStack stack) {
+        auto &entry = entries[ip];
+        if (!entry) {
+            entry = std::move(stack);
+        } else {
+            if (!unify(arena, *entry, stack)) {
+                return;
+            }
+            if (++changes[ip] > widen_after) {
+                widen(arena, *entry);
+            }
+        }
+        if (!pending[ip]) {
+            pending[ip] = true;
+            work.emplace_back(ip);
+        }
+    };
+
+    std::vector<TypeId> initial;
     if (expected.is_ellipses) {
-        initial.emplace_back(tstack_any);
+        initial.emplace_back(arena.stack_any());
     }
     initial.insert(initial.end(), expected.args.begin(), expected.args.end());
-
-    std::vector<State> states{State{0, initial}};
-    std::unordered_map<std::size_t, std::vector<Type>> been_to{};
+    flow(0, TypeStack{initial, &scratch});
 
     if (show_typechecks) {
-        std::println("STATES - {}", fn.name);
+        std::println("BLOCKS - {}", fname);
     }
-    while (!states.empty()) {
-        State &current = states.back();
-        auto instr = fn.body[current.ip];
-        auto &stack = current.stack;
+    while (!work.empty()) {
+        auto start = work.back();
+        work.pop_back();
+        pending[start] = false;
+        auto stack = *entries[start];
+
+        for (auto ip = start;; ++ip) {
+            assert(ip < body.size() && "Path runs past the function end");
+            if (ip != start && starts_block[ip]) {
+                flow(ip, std::move(stack));
+                break;
+            }
+            auto const &instr = body[ip];
 
-        if (show_typechecks) {
-            std::println("State count: {}", states.size());
-            std::println("On {}", instr.show());
-            print_stk(stack);
-            std::println("");
-        }
+            if (show_typechecks) {
+                std::println("Pending blocks: {}", work.size());
+                std::println("On {}", body.show(instr));
+                print_stk(arena, stack);
+                std::println("");
+            }
+            bool block_ends{false};
+            switch (instr.kind) {
+            case ir::Instruction::PushInt:
+                stack.push(arena.scalar(Type::Int));
+                break;
+            case ir::Instruction::PushFloat:
+                stack.push(arena.scalar(Type::Float));
+                break;
+            case ir::Instruction::PushChar:
+                stack.push(arena.scalar(Type::Char));
+                break;
+            case ir::Instruction::PushStr:
+                stack.push(arena.scalar(Type::String));
+                break;
+            case ir::Instruction::Call: {
+                auto callee = instr.callee();
+                auto sig = sigs.find(callee);
+                if (!sig || !*sig) {
+                    throw CheckError(
+                        std::format("Attempted to call undefined function '{}'",
+                                    symbols::name(callee)),
+                        fname);
+                }
+                try_apply(arena, stack, **sig, fname, symbols::name(callee));
+                break;
+            }
+            case ir::Instruction::JumpTrue: {
+                if (stack.empty() || arena[stack.top()].kind != Type::Bool) {
+                    throw CheckError(
+                        "Branch expected bool, got " +
+                            (stack.empty() ? "nothing"
+                                           : arena.show(stack.top())),
+                        fname);
+                }
+                stack.pop();
+                auto target = label_at(instr);
+                flow(ip + 1, stack);
+                flow(target, std::move(stack));
+                block_ends = true;
+                break;
+            }
+            case ir::Instruction::Goto:
+                flow(label_at(instr), std::move(stack));
+                block_ends = true;
+                break;
+            case ir::Instruction::Label:
+                break;
+            case ir::Instruction::Exit: {
+                auto have = stack.begin();
+                auto want = expected.rets.rbegin();
+
+                for (; want != expected.rets.rend(); ++have, ++want) {
+                    if (have == stack.end()) {
+                        throw CheckError{
+                            std::format("Needed to return '{}', got nothing",
+                                        arena.show(*want)),
+                            fname};
+                    }
+                    if (!arena.matches(*have, *want)) {
+                        throw CheckError{
+                            std::format("Needed to return '{}', got '{}'",
+                                        arena.show(*want), arena.show(*have)),
+                            fname};
+                    }
+                }
 
-        if (been_to.contains(current.ip)) {
-            auto &prev = been_to[current.ip];
-            if (!unify(prev, stack)) {
-                states.pop_back();
-                continue;
+                if (expected.returns_many) {
+                    for (; have != stack.end(); ++have) {
+                        if (!arena.matches(*have, *expected.returns_many)) {
+                            throw CheckError{
+                                std::format("Needed to return '{}', got '{}'",
+                                            arena.show(*expected.returns_many),
+                                            arena.show(*have)),
+                                fname};
+                        }
+                    }
+                }
+                block_ends = true;
+                break;
+            }
+            case ir::Instruction::GotoPos:
+            case ir::Instruction::LabelPos:
+                assert(false && "Unreachable instruction in type check");
+                break;
+            }
+            if (block_ends) {
+                break;
             }
-        } else {
-            // Enough to store labels?
-            // been_to[current.ip] = std::vector{stack};
         }
+    }
+    return prove(body);
+}
 
+std::vector<checks::Fact>
+checks::TypeChecker::prove(ir::Body const &body) const {
+    // The kinds before each instruction, joined over every path reaching it
+    std::vector<std::optional<Kinds>> before(body.size());
+    std::vector<std::size_t> work{};
+    auto flow = [&](std::size_t ip, Kinds const &kinds) {
+        assert(ip < body.size() && "Path runs past the function end");
+        auto &entry = before[ip];
+        if (!entry) {
+            entry = kinds;
+        } else if (!meet(*entry, kinds)) {
+            return;
+        }
+        work.emplace_back(ip);
+    };
+    auto label_at = [&](ir::Instruction jump) {
+        return *body.ip_of(jump.label());
+    };
+
+    flow(0, {});
+    while (!work.empty()) {
+        auto ip = work.back();
+        work.pop_back();
+        auto kinds = *before[ip];
+        auto const &instr = body[ip];
         switch (instr.kind) {
         case ir::Instruction::PushInt:
-            stack.emplace_back(tint);
-            ++current.ip;
+            kinds.insert(kinds.begin(), Type::Int);
             break;
         case ir::Instruction::PushFloat:
-            stack.emplace_back(tfloat);
-            ++current.ip;
+            kinds.insert(kinds.begin(), Type::Float);
             break;
         case ir::Instruction::PushChar:
-            stack.emplace_back(tchar);
-            ++current.ip;
+            kinds.insert(kinds.begin(), Type::Char);
             break;
         case ir::Instruction::PushStr:
-            stack.emplace_back(tstring);
-            ++current.ip;
+            kinds.insert(kinds.begin(), Type::String);
             break;
         case ir::Instruction::Call: {
-            auto callee = std::get<std::string>(instr.value);
-            if (!sigs.contains(callee)) {
-                throw CheckError(
-                    std::format("Attempted to call undefined function '{}'",
-                                callee),
-                    fn.name);
+            if (auto builtin = builtins::find(instr.callee())) {
+                apply_builtin(kinds, *builtin);
+                break;
             }
-            try_apply(stack, sigs[callee], fn.name, callee);
-            ++current.ip;
-            break;
-        }
-        case ir::Instruction::JumpTrue: {
-            if (stack.empty() || stack.back().kind != Type::Bool) {
-                throw CheckError(
-                    "Branch expected bool, got " +
-                        (stack.empty() ? "nothing" : stack.back().show()),
-                    fn.name);
-            }
-            stack.pop_back();
-            auto label_name = std::get<std::string>(instr.value);
-            auto label_pos = get_label(fn.body, label_name);
-            if (label_pos == fn.body.end()) {
-                throw CheckError("Attempted to jump to invalid label '" +
-                                     label_name + "'",
-                                 fn.name);
+            // Declared types don't say which member of a union a value
+            // has, so what a function returns is unknown
+            auto const &sig = **sigs.find(instr.callee());
+            if (sig.is_ellipses || sig.returns_many) {
+                kinds.clear();
+            } else {
+                drop(kinds, sig.args.size());
+                kinds.insert(kinds.begin(), sig.rets.size(), std::nullopt);
             }
-            ++current.ip;
-            states.emplace_back(State{
-                static_cast<size_t>(std::distance(fn.body.cbegin(), label_pos)),
-                std::vector{stack}});
             break;
         }
-        case ir::Instruction::Goto: {
-            auto label_name = std::get<std::string>(instr.value);
-            auto label_pos = get_label(fn.body, label_name);
-            if (label_pos == fn.body.end()) {
-                throw CheckError("Attempted to jump to invalid label '" +
-                                     label_name + "'",
-                                 fn.name);
-            }
-            current.ip = std::distance(fn.body.cbegin(), label_pos);
+        case ir::Instruction::JumpTrue:
+            drop(kinds, 1);
+            flow(label_at(instr), kinds);
             break;
-        }
+        case ir::Instruction::Goto:
+            flow(label_at(instr), kinds);
+            continue;
+        case ir::Instruction::Exit:
+            continue;
         case ir::Instruction::Label:
-            if (!been_to.contains(current.ip))
-                been_to[current.ip] = std::vector{stack};
-            ++current.ip;
-            break;
-        case ir::Instruction::Exit: {
-            auto have = stack.rbegin();
-            auto want = expected.rets.rbegin();
-
-            for (; want != expected.rets.rend(); ++have, ++want) {
-                if (have == stack.rend()) {
-                    throw CheckError{
-                        std::format("Needed to return '{}', got nothing",
-                                    want->show()),
-                        fn.name};
-                }
-                if (!is_matching(*have, *want)) {
-                    throw CheckError{
-                        std::format("Needed to return '{}', got '{}'",
-                                    want->show(), have->show()),
-                        fn.name};
-                }
-            }
-
-            if (expected.returns_many) {
-                for (; have != stack.rend(); ++have) {
-                    if (!is_matching(*have, *expected.returns_many)) {
-                        throw CheckError{
-                            std::format("Needed to return '{}', got '{}'",
-                                        expected.returns_many->show(),
-                                        have->show()),
-                            fn.name};
-                    }
-                }
-            }
-            states.pop_back();
             break;
-        }
         case ir::Instruction::GotoPos:
         case ir::Instruction::LabelPos:
             assert(false && "Unreachable instruction in type check");
             break;
         }
+        flow(ip + 1, kinds);
     }
-}
 
-void checks::TypeChecker::check() {
-    collect_sigs();
-    for (auto &fn : fns) {
-        verify(fn);
-    }
-}
-
-std::string checks::Type::show() const {
-    switch (kind) {
-    case Int:
-        return "int";
-    case Float:
-        return "float";
-    case Bool:
-        return "bool";
-    case Char:
-        return "char";
-    case String:
-        return "string";
-    case Stack: {
-        return std::get<StackType>(val).show();
-    }
-    case Generic: {
-        return std::get<std::string>(val);
-    }
-    case Union: {
-        auto vals = std::get<2>(val);
-        std::string un{vals.front().show()};
-        for (auto v = vals.begin() + 1; v != vals.end(); ++v) {
-            un += " | " + v->show();
+    std::vector<Fact> facts(body.size());
+    for (std::size_t ip = 0; ip < body.size(); ++ip) {
+        if (auto const &kinds = before[ip]) {
+            facts[ip] = Fact{true, kind_at(*kinds, 0), kind_at(*kinds, 1)};
         }
-        return un;
-    }
-    case Many: {
-        return "many(" + std::get<3>(val)->show() + ")";
-    }
     }
+    return facts;
 }
 
-std::string checks::StackType::show() const {
-    switch (kind) {
-    case Exact: {
-        auto elems = std::get<std::vector<Type>>(val);
-        std::string stk{};
-        if (!elems.empty()) {
-            stk += elems.front().show();
-            for (auto elem = elems.begin() + 1; elem != elems.end(); ++elem) {
-                stk += ", " + elem->show();
-            }
+checks::Facts checks::TypeChecker::check() {
+    // Past this point the signatures are only read, so functions can be
+    // verified independently. The trace output is kept in order by running
+    // serially when it is on.
+    std::vector<std::vector<Fact>> results(fns.size());
+    auto verify_at = [&](std::size_t i) { results[i] = verify(fns[i]); };
+    if (show_typechecks) {
+        for (std::size_t i = 0; i < fns.size(); ++i) {
+            verify_at(i);
         }
-        return "[" + stk + "]";
+    } else {
+        pool::shared().for_each(fns.size(), verify_at);
     }
-    case Many:
-        return "[..." + std::get<std::shared_ptr<Type>>(val)->show() + "]";
-    case Unknown:
-        return "[?]";
+    for (std::size_t i = 0; i < fns.size(); ++i) {
+        facts[fns[i].name] = std::move(results[i]);
     }
+    return facts;
 }
 
-// clang-format off
-static const std::unordered_map<std::string, checks::Function> internal_sigs {
-  {"⇈",   { {generic("a")}, {generic("a"), generic("a")} }},
-  {"dup", { {generic("a")}, {generic("a"), generic("a")} }},
-
-  {"=",   { {generic("a"), generic("b")}, {tbool} }},
-  {"!=",  { {generic("a"), generic("b")}, {tbool} }},
-  {"≠",   { {generic("a"), generic("b")}, {tbool} }},
-  {"<",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tbool} }},
-  {">",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tbool} }},
-  {">=",  { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tbool} }},
-  {"<=",  { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tbool} }},
-  {"≤",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tbool} }},
-  {"≥",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tbool} }},
-
-  {"↕",   { {generic("a"), generic("b")}, {generic("b"), generic("a")} }},
-  {"swp", { {generic("a"), generic("b")}, {generic("b"), generic("a")} }},
-
-  {"rot", { {generic("a"), generic("b"), generic("c")},
-            {generic("c"), generic("a"), generic("b")} }},
-  {"↻",   { {generic("a"), generic("b"), generic("c")},
-            {generic("c"), generic("a"), generic("b")} }},
-
-  {"rot-", { {generic("a"), generic("b"), generic("c")},
-             {generic("b"), generic("c"), generic("a")} }},
-  {"↷",    { {generic("a"), generic("b"), generic("c")},
-             {generic("b"), generic("c"), generic("a")} }},
-
-  {"dbg", { {}, {} }},
-
-  {"+",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tsum(tint, tfloat)} }},
-  {"-",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tsum(tint, tfloat)} }},
-  {"*",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tsum(tint, tfloat)} }},
-  {"/",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tsum(tint, tfloat)} }},
-  {"%",   { {tsum(tint, tfloat), tsum(tint, tfloat)}, {tsum(tint, tfloat)} }},
-
-  {"box", { {}, {tstack_any}, true, {} }},
-  {"▭",   { {}, {tstack_any}, true, {} }},
-
-  {"pop", { {generic("a")}, {} }},
-  {"◌",   { {generic("a")}, {} }},
-
-  {"ins", { {generic("a"), tstack_any}, {tstack_any} }},
-  {"⤓",   { {generic("a"), tstack_any}, {tstack_any} }},
-
-  {"fst!", { {tstack_any}, {generic("a"), tstack_any} }},
-  {"⊢!",   { {tstack_any}, {generic("a"), tstack_any} }},
-  {"lst!", { {tstack_any}, {generic("a"), tstack_any} }},
-  {"⊣!",   { {tstack_any}, {generic("a"), tstack_any} }},
-  {"fst",  { {tstack_any}, {generic("a"), tstack_any} }},
-  {"⊢",    { {tstack_any}, {generic("a"), tstack_any} }},
-  {"lst",  { {tstack_any}, {generic("a"), tstack_any} }},
-  {"⊣",    { {tstack_any}, {generic("a"), tstack_any} }},
-
-  {"print", { {generic("a")}, {} } }
-};
-// clang-format on
-
-checks::TypeChecker::TypeChecker(std::vector<traverser::Function> fns,
-                                 bool show_typechecks)
-    : fns(std::move(fns)), sigs(internal_sigs),
-      show_typechecks(show_typechecks) {}
-
-bool checks::Type::operator==(Type const &other) const {
-    if (kind != other.kind)
-        return false;
+std::vector<checks::Fact>
+checks::TypeChecker::check(traverser::Function const &fn) const {
+    return verify(fn);
+}
 
-    switch (kind) {
-    case Int:
-    case Float:
-    case Bool:
-    case Char:
-    case String:
-        return true;
-    case Union: {
-        auto const &a = std::get<2>(val);
-        auto const &b = std::get<2>(other.val);
-        if (a.size() != b.size())
-            return false;
-        for (auto &t : a) {
-            if (std::none_of(b.begin(), b.end(),
-                             [&](auto &u) { return t == u; }))
-                return false;
+void checks::TypeChecker::add_internal_sigs() {
+    std::array generics{types.generic("#a"), types.generic("#b"),
+                        types.generic("#c")};
+    auto tbool = types.scalar(Type::Bool);
+    auto num = types.sum({types.scalar(Type::Int), types.scalar(Type::Float)});
+    auto stk = types.stack_any();
+    auto type_of = [&](builtins::Slot slot) {
+        switch (slot) {
+        case builtins::Slot::A:
+        case builtins::Slot::B:
+        case builtins::Slot::C:
+            return generics[static_cast<std::size_t>(slot)];
+        case builtins::Slot::Bool:
+            return tbool;
+        case builtins::Slot::Num:
+            return num;
+        case builtins::Slot::Stack:
+            return stk;
         }
-        return true;
-    }
-    case Stack:
-        return std::get<1>(val) == std::get<1>(other.val);
-    case Generic:
-        return std::get<0>(val) == std::get<0>(other.val);
-    case Many:
-        return *std::get<3>(val) == *std::get<3>(other.val);
+        return stk;
+    };
+    for (auto const &builtin : builtins::table) {
+        Function sig{};
+        for (auto slot : builtin.args) {
+            sig.args.emplace_back(type_of(slot));
+        }
+        for (auto slot : builtin.rets) {
+            sig.rets.emplace_back(type_of(slot));
+        }
+        sig.is_ellipses = builtin.takes_all;
+        sigs[builtins::id(builtin)] = std::move(sig);
     }
 }
 
-bool checks::StackType::operator==(StackType const &other) const {
-    if (kind != other.kind)
-        return false;
-
-    switch (kind) {
-    case Exact:
-        return std::get<0>(val) == std::get<0>(other.val);
-    case Many:
-        return *std::get<1>(val) == *std::get<1>(other.val);
-    case Unknown:
-        return true;
-    }
+checks::TypeChecker::TypeChecker(std::vector<traverser::Function> fns,
+                                 bool show_typechecks)
+    : fns(std::move(fns)), show_typechecks(show_typechecks) {
+    add_internal_sigs();
+    collect_sigs();
 }
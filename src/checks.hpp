@@ -1,8 +1,12 @@
 #pragma once
 
 #include "parser.hpp"
+#include "symbols.hpp"
 #include "traverser.hpp"
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <memory_resource>
 #include <optional>
 #include <print>
 #include <unordered_map>
@@ -13,16 +17,9 @@ struct CheckError {
     std::string fname;
 };
 
-struct Type;
-
-struct StackType {
-    enum Kind { Exact, Many, Unknown } kind;
-    std::variant<std::vector<Type>, std::shared_ptr<Type>> val;
-
-    std::string show() const;
-
-    bool operator==(StackType const &other) const;
-};
+// Handle to a type in a TypeArena. Types are hash-consed, so two handles
+// from the same arena are equal exactly when the types are.
+enum class TypeId : std::uint32_t {};
 
 struct Type {
     enum Kind {
@@ -36,47 +33,189 @@ struct Type {
         Generic,
         Many
     } kind;
-    std::variant<std::string, StackType, std::vector<Type>,
-                 std::shared_ptr<Type>>
-        val;
+    // What a Stack holds: the listed elements, any number of one element
+    // type, or anything
+    enum StackKind : std::uint8_t { Exact, Repeated, Unknown } stack{Exact};
+    // Name of a Generic, including the '#'
+    symbols::Id tag{};
+    // Members of a Union, sorted and without duplicates; the element of a
+    // Many or a Repeated stack; the elements of an Exact stack
+    std::vector<TypeId> elems{};
+
+    bool operator==(Type const &other) const = default;
+};
+
+struct TypeHash {
+    std::size_t operator()(Type const &t) const;
+};
+
+struct TypeIdsHash {
+    std::size_t operator()(std::vector<TypeId> const &ids) const;
+};
 
-    std::string show() const;
-    bool operator==(Type const &other) const;
+// Owns every type the checker builds. An arena may sit on top of a parent
+// that no longer changes: types already in the parent keep its handles, and
+// new ones are numbered after them. Each function is checked in its own
+// arena over the shared one holding the signatures, so checks running in
+// parallel never write to the same arena.
+class TypeArena {
+    TypeArena const *parent;
+    std::size_t base;
+    std::pmr::deque<Type> types;
+    std::pmr::unordered_map<Type, TypeId, TypeHash> ids;
+    std::pmr::unordered_map<std::uint64_t, bool> matching;
+    std::pmr::unordered_map<std::vector<TypeId>, TypeId, TypeIdsHash>
+        collapsed;
+
+    std::optional<TypeId> find(Type const &t) const;
+
+  public:
+    explicit TypeArena(
+        TypeArena const *parent = nullptr,
+        std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+    TypeArena(TypeArena const &) = delete;
+    TypeArena &operator=(TypeArena const &) = delete;
+
+    TypeId intern(Type t);
+    Type const &operator[](TypeId id) const;
+    std::size_t size() const { return base + types.size(); }
+
+    TypeId scalar(Type::Kind kind) { return intern(Type{kind}); }
+    TypeId generic(std::string_view name);
+    // Flattens nested unions; a single distinct member is returned as is
+    TypeId sum(std::vector<TypeId> members);
+    TypeId many(TypeId elem);
+    TypeId stack_of(TypeId elem);
+    TypeId stack_any();
+
+    // Whether a value of type got can be used where expected is wanted
+    bool matches(TypeId got, TypeId expected);
+    // Union of the given types with nested unions and manys flattened, and
+    // members that match each other merged
+    TypeId collapse(std::vector<TypeId> const &types);
+
+    std::string show(TypeId id) const;
+};
+
+// Abstract stack of a path through a function. Nodes never change once
+// built, so copies share them: forking a path is O(1), pushing and popping
+// only touch the top, and stacks that came from the same fork can be
+// compared by pointer below the point where they diverged.
+class TypeStack {
+    struct Node {
+        TypeId top;
+        std::size_t size;
+        std::shared_ptr<Node const> below;
+    };
+    std::shared_ptr<Node const> head{};
+    // Where new nodes come from
+    std::pmr::memory_resource *memory;
+
+  public:
+    // Walks from the top down
+    class iterator {
+        Node const *node;
+
+      public:
+        explicit iterator(Node const *node) : node(node) {}
+        TypeId operator*() const { return node->top; }
+        iterator &operator++() {
+            node = node->below.get();
+            return *this;
+        }
+        bool operator==(iterator const &other) const = default;
+        // Whether both walks have reached the same node, and so see the same
+        // types from here on
+        bool shares(iterator const &other) const { return node == other.node; }
+    };
+
+    explicit TypeStack(
+        std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : memory(memory) {}
+    // Bottom first
+    TypeStack(std::vector<TypeId> const &types,
+              std::pmr::memory_resource *memory);
+    TypeStack(TypeStack const &) = default;
+    TypeStack(TypeStack &&) = default;
+    TypeStack &operator=(TypeStack other);
+    ~TypeStack();
+
+    std::pmr::memory_resource *resource() const { return memory; }
+    bool empty() const { return !head; }
+    std::size_t size() const { return head ? head->size : 0; }
+    TypeId top() const { return head->top; }
+    iterator begin() const { return iterator{head.get()}; }
+    iterator end() const { return iterator{nullptr}; }
+
+    void push(TypeId t);
+    void pop();
+    void clear();
+    // Without its top count entries
+    TypeStack drop(std::size_t count) const;
+    // Rebuilds the stack down to the deepest from, sharing what is below it
+    void replace(TypeId from, TypeId to);
+    // Bottom first
+    std::vector<TypeId> types() const;
+
+    bool operator==(TypeStack const &other) const;
 };
 
 struct Function {
-    std::vector<Type> args;
-    std::vector<Type> rets;
+    std::vector<TypeId> args;
+    std::vector<TypeId> rets;
     bool is_ellipses{false};
-    std::optional<Type> returns_many{std::nullopt};
+    std::optional<TypeId> returns_many{std::nullopt};
 
     Function()
         : args{}, rets{}, is_ellipses{false}, returns_many{std::nullopt} {}
 
-    Function(std::vector<Type> args, std::vector<Type> rets)
+    Function(std::vector<TypeId> args, std::vector<TypeId> rets)
         : args(std::move(args)), rets(std::move(rets)), is_ellipses{false} {}
 
-    Function(std::vector<Type> args, std::vector<Type> rets, bool is_ellipses,
-             std::optional<Type> returns_many)
+    Function(std::vector<TypeId> args, std::vector<TypeId> rets,
+             bool is_ellipses, std::optional<TypeId> returns_many)
         : args(std::move(args)), rets(std::move(rets)),
           is_ellipses{is_ellipses}, returns_many{std::move(returns_many)} {}
 };
 
+// What the checker proved about the stack right before an instruction.
+// Kinds are only set when every path agrees on them, and only follow values
+// the function made itself: a union passes for any of its members, so a
+// declared type doesn't say what a value holds.
+struct Fact {
+    bool reached{false};
+    std::optional<Type::Kind> top{};
+    std::optional<Type::Kind> below{};
+};
+
+using Facts = symbols::Table<std::vector<Fact>>;
+
 class TypeChecker {
     std::vector<traverser::Function> fns;
-    std::unordered_map<std::string, Function> sigs;
+    // Holds the signatures, and is only read once they are collected
+    TypeArena types{};
+    symbols::Table<std::optional<Function>> sigs;
+    Facts facts;
     bool show_typechecks;
 
+    void add_internal_sigs();
     void collect_sigs();
-    void try_apply(std::vector<Type> &stack, Function sig, std::string caller,
-                   std::string callee);
-    bool unify(std::vector<Type> &prev, std::vector<Type> &current);
-    void verify(traverser::Function fn);
+    void try_apply(TypeArena &arena, TypeStack &stack,
+                   Function const &sig, std::string const &caller,
+                   std::string const &callee) const;
+    bool unify(TypeArena &arena, TypeStack &prev,
+               TypeStack const &current) const;
+    std::vector<Fact> verify(traverser::Function const &fn) const;
+    std::vector<Fact> prove(ir::Body const &body) const;
 
   public:
+    // Collects the signatures of fns; their bodies are only read by check()
     TypeChecker(std::vector<traverser::Function> fns,
                 bool show_typechecks = false);
 
-    void check();
+    Facts check();
+    // Checks one of the functions given to the constructor, whose own copy
+    // there may have left out the body
+    std::vector<Fact> check(traverser::Function const &fn) const;
 };
 }; // namespace checks
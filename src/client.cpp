@@ -0,0 +1,70 @@
+// Sends its arguments to a running `charta -serve` as one build request and
+// reports the result the way charta would
+#include "server.hpp"
+#include <cstring>
+#include <filesystem>
+#include <print>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    if (argc < 2)
+        return 1;
+    auto socket = server::socket_path().string();
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket.size() >= sizeof(address.sun_path)) {
+        std::println("Err: Socket path '{}' is too long", socket);
+        return 1;
+    }
+    std::memcpy(address.sun_path, socket.data(), socket.size());
+    int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || connect(server, reinterpret_cast<sockaddr *>(&address),
+                              sizeof(address)) < 0) {
+        std::println("Err: No server on '{}', start one with charta -serve",
+                     socket);
+        return 1;
+    }
+
+    std::string request{server::greeting};
+    request += "\n" + std::filesystem::current_path().string() + "\n";
+    for (int i = 1; i < argc; ++i) {
+        request += std::string{argv[i]} + "\n";
+    }
+    request += "\n";
+    for (std::size_t sent = 0; sent < request.size();) {
+        auto wrote =
+            write(server, request.data() + sent, request.size() - sent);
+        if (wrote <= 0) {
+            std::println("Err: Lost the server");
+            return 1;
+        }
+        sent += wrote;
+    }
+
+    std::string reply{};
+    char chunk[4096];
+    for (ssize_t got; (got = read(server, chunk, sizeof(chunk))) > 0;) {
+        reply.append(chunk, got);
+    }
+    close(server);
+    if (reply.starts_with("ok ")) {
+        return 0;
+    }
+    if (!reply.starts_with("err ")) {
+        std::println("Err: Lost the server");
+        return 1;
+    }
+    // err <start> <end> <message>
+    auto message = reply.substr(4);
+    for (int field = 0; field < 2; ++field) {
+        message = message.substr(message.find(' ') + 1);
+    }
+    if (message.ends_with('\n')) {
+        message.pop_back();
+    }
+    std::println("Err: {}", message);
+    return 1;
+}
@@ -0,0 +1,144 @@
+#include "host.hpp"
+#include <algorithm>
+#include <dlfcn.h>
+#include <format>
+#include <type_traits>
+#include <utility>
+
+ch_value to_native(host::Value const &v);
+
+ch_stack_node *to_native(host::Stack const &stack) {
+    ch_stack_node *stk = ch_stk_new();
+    for (auto const &v : stack) {
+        ch_stk_push(&stk, to_native(v));
+    }
+    return stk;
+}
+
+ch_value to_native(host::Value const &v) {
+    return std::visit(
+        [](auto const &x) -> ch_value {
+            using T = std::decay_t<decltype(x)>;
+            if constexpr (std::is_same_v<T, int>) {
+                return ch_valof_int(x);
+            } else if constexpr (std::is_same_v<T, float>) {
+                return ch_valof_float(x);
+            } else if constexpr (std::is_same_v<T, bool>) {
+                return ch_valof_bool(x);
+            } else if constexpr (std::is_same_v<T, char32_t>) {
+                return ch_valof_char(x);
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                return ch_valof_string(ch_str_new(x.c_str()));
+            } else {
+                return ch_value{.kind = CH_VALK_STACK,
+                                .value = {.stk = to_native(x)}};
+            }
+        },
+        v.value);
+}
+
+host::Value from_native(ch_value const &v);
+
+// Copies a top-first list into a bottom-to-top stack
+host::Stack from_native(ch_stack_node const *stk) {
+    host::Stack stack{};
+    for (; stk; stk = stk->next) {
+        stack.emplace_back(from_native(stk->val));
+    }
+    std::reverse(stack.begin(), stack.end());
+    return stack;
+}
+
+host::Value from_native(ch_value const &v) {
+    switch (v.kind) {
+    case CH_VALK_INT:
+        return {v.value.i};
+    case CH_VALK_FLOAT:
+        return {v.value.f};
+    case CH_VALK_BOOL:
+        return {static_cast<bool>(v.value.b)};
+    case CH_VALK_CHAR:
+        return {static_cast<char32_t>(v.value.i)};
+    case CH_VALK_STRING:
+        return {std::string(v.value.s.data, v.value.s.len)};
+    case CH_VALK_STACK:
+        return {from_native(v.value.stk)};
+    }
+    throw host::HostError{"Unknown value kind"};
+}
+
+host::Stack host::Function::operator()(Stack const &args) const {
+    if (!fn) {
+        throw HostError{"Call through an empty function"};
+    }
+    ch_stack_node *stk = to_native(args);
+    ch_stack_node *rets = nullptr;
+    char err[256];
+    if (try_call(fn, &stk, &rets, err, sizeof(err))) {
+        ch_stk_delete(&stk);
+        throw HostError{err};
+    }
+    Stack result{from_native(rets)};
+    ch_stk_delete(&rets);
+    ch_stk_delete(&stk);
+    return result;
+}
+
+host::Library::Library(std::string const &path) {
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        throw HostError{
+            std::format("Could not load '{}': {}", path, dlerror())};
+    }
+    auto table =
+        static_cast<ch_builtin const *>(dlsym(handle, "ch_exports"));
+    if (!table) {
+        dlclose(handle);
+        throw HostError{
+            std::format("'{}' was not built with -shared", path)};
+    }
+    try_call = reinterpret_cast<TryCall>(dlsym(handle, "ch_try_call"));
+    if (!try_call) {
+        dlclose(handle);
+        throw HostError{
+            std::format("'{}' was built against an older runtime", path)};
+    }
+    for (; table->name; ++table) {
+        exports.emplace(table->name, table->fn);
+    }
+}
+
+host::Library::Library(Library &&other)
+    : handle(std::exchange(other.handle, nullptr)),
+      try_call(other.try_call), exports(std::move(other.exports)) {}
+
+host::Library &host::Library::operator=(Library &&other) {
+    if (this != &other) {
+        if (handle) {
+            dlclose(handle);
+        }
+        handle = std::exchange(other.handle, nullptr);
+        try_call = other.try_call;
+        exports = std::move(other.exports);
+    }
+    return *this;
+}
+
+host::Library::~Library() {
+    if (handle) {
+        dlclose(handle);
+    }
+}
+
+host::Function host::Library::get(std::string const &name) const {
+    auto entry = exports.find(name);
+    if (entry == exports.end()) {
+        throw HostError{std::format("No function named '{}'", name)};
+    }
+    return Function{entry->second, try_call};
+}
+
+host::Stack host::Library::call(std::string const &name,
+                                Stack const &args) const {
+    return get(name)(args);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+extern "C" {
+#include "core.h"
+}
+
+// Loads Charta programs built with -shared into a C++ host
+namespace host {
+struct Value;
+// Bottom to top, the order values were pushed in
+using Stack = std::vector<Value>;
+
+struct Value {
+    std::variant<int, float, bool, char32_t, std::string, Stack> value;
+};
+
+struct HostError {
+    std::string what;
+};
+
+// ch_try_call of the runtime a function was linked against
+using TryCall = int (*)(ch_builtin_fn, ch_stack_node **, ch_stack_node **,
+                        char *, std::size_t);
+
+// A resolved entry point, cheap to copy and to call many times.
+// The runtime only keeps per-thread state, so different threads may call
+// into the same library at once as long as they pass their own stacks.
+// A runtime error in the call is thrown as a HostError.
+class Function {
+    ch_builtin_fn fn{nullptr};
+    TryCall try_call{nullptr};
+
+  public:
+    Function() = default;
+    // A function linked into this program
+    explicit Function(ch_builtin_fn fn) : fn(fn), try_call(ch_try_call) {}
+    Function(ch_builtin_fn fn, TryCall try_call)
+        : fn(fn), try_call(try_call) {}
+
+    Stack operator()(Stack const &args) const;
+};
+
+class Library {
+    void *handle{nullptr};
+    // The library carries its own copy of the runtime
+    TryCall try_call{nullptr};
+    std::unordered_map<std::string, ch_builtin_fn> exports{};
+
+  public:
+    explicit Library(std::string const &path);
+    Library(Library const &) = delete;
+    Library &operator=(Library const &) = delete;
+    Library(Library &&other);
+    Library &operator=(Library &&other);
+    ~Library();
+
+    Function get(std::string const &name) const;
+
+    Stack call(std::string const &name, Stack const &args) const;
+};
+} // namespace host
@@ -1,38 +1,42 @@
 #include "ir.hpp"
 #include "parser.hpp"
 #include "utf.hpp"
+#include <format>
 #include <iomanip>
 #include <sstream>
 
-std::string ir::Instruction::show() {
-    switch (kind) {
-    case PushInt:
-        return "Push " + std::to_string(std::get<int>(value));
-    case PushFloat:
-        return "Push " + std::to_string(std::get<float>(value));
-    case PushChar: {
-      return "Push " + parser::quote_chr(std::get<char32_t>(value));
+std::string ir::Body::label_name(LabelId label) const {
+    auto const &site = labels[index(label)];
+    return std::format("{}_{}_{}", site.branch ? 'B' : 'P', site.x, site.y);
+}
+
+std::string ir::Body::show(Instruction instr) const {
+    switch (instr.kind) {
+    case Instruction::PushInt:
+        return "Push " + std::to_string(instr.int_value());
+    case Instruction::PushFloat:
+        return "Push " + std::to_string(instr.float_value());
+    case Instruction::PushChar: {
+      return "Push " + parser::quote_chr(instr.char_value());
     }
-    case PushStr: {
-      return "Push " + parser::quote_str(std::get<std::string>(value));
+    case Instruction::PushStr: {
+      return "Push " + parser::quote_str(string(instr));
     }
-    case Call:
-        return "Call " + std::get<std::string>(value);
-    case JumpTrue:
-        return "JumpTrue " + std::get<std::string>(value);
-    case Goto:
-        return "Goto " + std::get<std::string>(value);
-    case Label:
-        return "Label " + std::get<std::string>(value);
-    case Exit:
+    case Instruction::Call:
+        return "Call " + symbols::name(instr.callee());
+    case Instruction::JumpTrue:
+        return "JumpTrue " + label_name(instr.label());
+    case Instruction::Goto:
+        return "Goto " + label_name(instr.label());
+    case Instruction::Label:
+        return "Label " + label_name(instr.label());
+    case Instruction::Exit:
         return "Exit";
-    case GotoPos: {
-        auto pos = std::get<IrPos>(value);
-        return std::format("Goto ({},{})", pos.x, pos.y);
-    }
-    case LabelPos: {
-        auto pos = std::get<IrPos>(value);
-        return std::format("Label ({},{},{})", pos.x, pos.y, pos.length);
-    }
+    case Instruction::GotoPos:
+    case Instruction::LabelPos:
+        return std::format("{} <unresolved>",
+                           instr.kind == Instruction::GotoPos ? "Goto"
+                                                              : "Label");
     }
+    return "";
 }
@@ -1,18 +1,21 @@
 #pragma once
 
+#include "symbols.hpp"
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <optional>
 #include <string>
-#include <variant>
+#include <vector>
 
 namespace ir {
-struct IrPos {
-    int x;
-    int y;
-    std::size_t length{0};
-};
+// Labels are numbered per function, from 0
+enum class LabelId : std::uint32_t {};
+
+inline std::size_t index(LabelId id) { return static_cast<std::size_t>(id); }
 
 struct Instruction {
-    enum Kind {
+    enum Kind : std::uint8_t {
         PushInt,
         PushFloat,
         PushChar,
@@ -22,12 +25,75 @@ struct Instruction {
         Goto,
         Label,
         Exit,
+        // Only seen inside the traverser, before jumps are resolved
         GotoPos,
         LabelPos
     } kind;
 
-    std::variant<int, float, char32_t, std::string, IrPos> value;
+    // The int, float or char pushed; the index of the pushed string in
+    // Body::strings; the callee's symbol; or the label jumped to or defined.
+    // Read it through the accessor for the kind.
+    std::uint32_t operand{0};
+
+    static Instruction push(int v) {
+        return {PushInt, std::bit_cast<std::uint32_t>(v)};
+    }
+    static Instruction push(float v) {
+        return {PushFloat, std::bit_cast<std::uint32_t>(v)};
+    }
+    static Instruction push(char32_t v) {
+        return {PushChar, static_cast<std::uint32_t>(v)};
+    }
+    static Instruction call(symbols::Id callee) {
+        return {Call, static_cast<std::uint32_t>(callee)};
+    }
+    static Instruction to(Kind kind, LabelId label) {
+        return {kind, static_cast<std::uint32_t>(label)};
+    }
+
+    int int_value() const { return std::bit_cast<int>(operand); }
+    float float_value() const { return std::bit_cast<float>(operand); }
+    char32_t char_value() const { return static_cast<char32_t>(operand); }
+    symbols::Id callee() const { return symbols::Id{operand}; }
+    LabelId label() const { return LabelId{operand}; }
+};
+
+static_assert(sizeof(Instruction) == 8);
+
+// Cell a label is named after: a branch, or the place a path ran into cells
+// that were already walked
+struct LabelSite {
+    bool branch;
+    int x;
+    int y;
+};
+
+// A function's instructions and the tables their operands index into
+struct Body {
+    std::vector<Instruction> code{};
+    std::vector<std::string> strings{};
+    std::vector<LabelSite> labels{};
+    // Position in code of the one Label instruction of each label, or
+    // nowhere for a label that is jumped to but never placed
+    std::vector<std::uint32_t> label_ips{};
+
+    static constexpr std::uint32_t nowhere = UINT32_MAX;
+
+    auto begin() const { return code.begin(); }
+    auto end() const { return code.end(); }
+    std::size_t size() const { return code.size(); }
+    Instruction const &operator[](std::size_t ip) const { return code[ip]; }
+
+    std::string const &string(Instruction instr) const {
+        return strings[instr.operand];
+    }
+    std::optional<std::size_t> ip_of(LabelId label) const {
+        auto ip = label_ips[index(label)];
+        return ip == nowhere ? std::nullopt : std::optional<std::size_t>{ip};
+    }
+    // Stable across builds of the same grid: B_x_y or P_x_y
+    std::string label_name(LabelId label) const;
 
-    std::string show();
+    std::string show(Instruction instr) const;
 };
 } // namespace ir
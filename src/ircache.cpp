@@ -0,0 +1,349 @@
+#include "ircache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <type_traits>
+#include <unistd.h>
+
+struct Header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t hash;
+    std::uint64_t size;
+    std::uint32_t library;
+    std::uint32_t symbols;
+    std::uint32_t functions;
+    std::uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<Header>);
+static_assert(std::is_trivially_copyable_v<ir::Instruction>);
+static_assert(std::is_trivially_copyable_v<ir::LabelSite>);
+
+static constexpr char magic[4] = {'C', 'H', 'I', 'R'};
+
+// FNV-1a, which is the same from one build of the compiler to the next
+static std::uint64_t fnv1a(std::string_view bytes) {
+    std::uint64_t hash{0xcbf29ce484222325};
+    for (unsigned char c : bytes) {
+        hash = (hash ^ c) * 0x100000001b3;
+    }
+    return hash;
+}
+
+ircache::Key ircache::key_of(std::string_view source, bool library) {
+    return Key{fnv1a(source), source.size(), library};
+}
+
+std::filesystem::path
+ircache::path_for(std::filesystem::path const &source) {
+    auto path = source;
+    path += ".chir";
+    return path;
+}
+
+// Appends to a cache image, padding so that every value sits at a multiple
+// of its alignment from the start of the file
+class Writer {
+    std::string out{};
+
+    void align(std::size_t to) { out.resize((out.size() + to - 1) / to * to); }
+
+  public:
+    template <typename T> void put(T const &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        align(alignof(T));
+        out.append(reinterpret_cast<char const *>(&value), sizeof(T));
+    }
+    template <typename T> void put_array(std::vector<T> const &values) {
+        put(static_cast<std::uint32_t>(values.size()));
+        align(std::max<std::size_t>(alignof(T), 8));
+        out.append(reinterpret_cast<char const *>(values.data()),
+                   values.size() * sizeof(T));
+    }
+    void put_string(std::string_view s) {
+        put(static_cast<std::uint32_t>(s.size()));
+        out.append(s);
+    }
+    void put_typesig(parser::TypeSig const &type) {
+        put_string(type.name);
+        put(static_cast<std::uint32_t>(type.is_stack));
+    }
+
+    std::string const &image() const { return out; }
+};
+
+void ircache::write(std::filesystem::path const &path, Key key,
+                    std::vector<traverser::Function> const &fns) {
+    auto symbol_count = symbols::interner().size();
+    Writer w{};
+    Header header{{}, version, key.hash, key.size, key.library,
+                  static_cast<std::uint32_t>(symbol_count),
+                  static_cast<std::uint32_t>(fns.size()), 0};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    w.put(header);
+    for (std::size_t i = 0; i < symbol_count; ++i) {
+        w.put_string(symbols::name(symbols::Id{static_cast<std::uint32_t>(i)}));
+    }
+    for (auto const &fn : fns) {
+        w.put(static_cast<std::uint32_t>(fn.name));
+        w.put(static_cast<std::uint32_t>(fn.args.kind));
+        w.put(static_cast<std::uint32_t>(fn.args.args.size()));
+        for (auto const &[name, type] : fn.args.args) {
+            w.put_string(name);
+            w.put_typesig(type);
+        }
+        w.put(static_cast<std::uint32_t>(fn.rets.args.size()));
+        for (auto const &type : fn.rets.args) {
+            w.put_typesig(type);
+        }
+        w.put(static_cast<std::uint32_t>(fn.rets.rest.has_value()));
+        if (fn.rets.rest) {
+            w.put_typesig(*fn.rets.rest);
+        }
+        w.put_array(fn.body.code);
+        w.put(static_cast<std::uint32_t>(fn.body.strings.size()));
+        for (auto const &s : fn.body.strings) {
+            w.put_string(s);
+        }
+        w.put_array(fn.body.labels);
+        w.put_array(fn.body.label_ips);
+    }
+
+    // Readers never see a half-written cache, and writers in other threads
+    // or processes each have their own partial file
+    static std::atomic<std::uint64_t> writes{0};
+    auto partial = path;
+    partial += std::format(".{}.{}.partial", getpid(), writes++);
+    {
+        std::ofstream file(partial, std::ios::binary | std::ios::trunc);
+        file.write(w.image().data(), w.image().size());
+        if (!file) {
+            std::error_code ignored{};
+            std::filesystem::remove(partial, ignored);
+            return;
+        }
+    }
+    std::error_code ignored{};
+    std::filesystem::rename(partial, path, ignored);
+}
+
+// Reads a cache image back, failing on anything that would run past its end
+class Reader {
+    std::string_view in;
+    std::size_t cursor{0};
+
+    bool align(std::size_t to) {
+        cursor = (cursor + to - 1) / to * to;
+        return cursor <= in.size();
+    }
+
+  public:
+    explicit Reader(std::string_view in) : in(in) {}
+
+    template <typename T> std::optional<T> get() {
+        if (!align(alignof(T)) || in.size() - cursor < sizeof(T)) {
+            return {};
+        }
+        T value;
+        std::memcpy(&value, in.data() + cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+    // The mapping is page aligned, so an array at an aligned offset can be
+    // used where it is
+    template <typename T> std::optional<std::span<T const>> get_array() {
+        auto count = get<std::uint32_t>();
+        if (!count || !align(std::max<std::size_t>(alignof(T), 8)) ||
+            (in.size() - cursor) / sizeof(T) < *count) {
+            return {};
+        }
+        auto data = reinterpret_cast<T const *>(in.data() + cursor);
+        cursor += *count * sizeof(T);
+        return std::span<T const>{data, *count};
+    }
+    std::optional<std::string_view> get_string() {
+        auto length = get<std::uint32_t>();
+        if (!length || in.size() - cursor < *length) {
+            return {};
+        }
+        auto s = in.substr(cursor, *length);
+        cursor += *length;
+        return s;
+    }
+    std::optional<parser::TypeSig> get_typesig() {
+        auto name = get_string();
+        auto is_stack = get<std::uint32_t>();
+        if (!name || !is_stack) {
+            return {};
+        }
+        return parser::TypeSig{std::string{*name}, *is_stack != 0};
+    }
+};
+
+std::optional<ircache::Cache>
+ircache::Cache::open(std::filesystem::path const &path, Key key) {
+    Cache cache{};
+    try {
+        cache.file = source::Source::map(path);
+    } catch (source::SourceError) {
+        return {};
+    }
+    Reader r{cache.file.view()};
+    auto header = r.get<Header>();
+    if (!header || std::memcmp(header->magic, magic, sizeof(magic)) != 0 ||
+        header->version != version ||
+        Key{header->hash, header->size, header->library != 0} != key) {
+        return {};
+    }
+
+    std::vector<symbols::Id> ids{};
+    ids.reserve(header->symbols);
+    bool same_ids{true};
+    for (std::uint32_t i = 0; i < header->symbols; ++i) {
+        auto name = r.get_string();
+        if (!name) {
+            return {};
+        }
+        ids.emplace_back(symbols::intern(*name));
+        same_ids = same_ids && ids.back() == symbols::Id{i};
+    }
+    auto id_of = [&](std::uint32_t written) -> std::optional<symbols::Id> {
+        if (written >= ids.size()) {
+            return {};
+        }
+        return ids[written];
+    };
+
+    for (std::uint32_t i = 0; i < header->functions; ++i) {
+        Entry entry{};
+        auto name = r.get<std::uint32_t>();
+        auto kind = r.get<std::uint32_t>();
+        auto arg_count = r.get<std::uint32_t>();
+        if (!name || !id_of(*name) || !kind || !arg_count) {
+            return {};
+        }
+        entry.name = *id_of(*name);
+        entry.args.kind = *kind == parser::Argument::Ellipses
+                              ? parser::Argument::Ellipses
+                              : parser::Argument::Limited;
+        for (std::uint32_t k = 0; k < *arg_count; ++k) {
+            auto arg = r.get_string();
+            auto type = r.get_typesig();
+            if (!arg || !type) {
+                return {};
+            }
+            entry.args.args.emplace_back(std::string{*arg}, *type);
+        }
+        auto ret_count = r.get<std::uint32_t>();
+        if (!ret_count) {
+            return {};
+        }
+        for (std::uint32_t k = 0; k < *ret_count; ++k) {
+            auto type = r.get_typesig();
+            if (!type) {
+                return {};
+            }
+            entry.rets.args.emplace_back(*type);
+        }
+        auto has_rest = r.get<std::uint32_t>();
+        if (!has_rest) {
+            return {};
+        }
+        if (*has_rest) {
+            entry.rets.rest = r.get_typesig();
+            if (!entry.rets.rest) {
+                return {};
+            }
+        }
+
+        auto code = r.get_array<ir::Instruction>();
+        auto string_count = r.get<std::uint32_t>();
+        if (!code || !string_count) {
+            return {};
+        }
+        for (std::uint32_t k = 0; k < *string_count; ++k) {
+            auto s = r.get_string();
+            if (!s) {
+                return {};
+            }
+            entry.strings.emplace_back(*s);
+        }
+        auto labels = r.get_array<ir::LabelSite>();
+        auto label_ips = r.get_array<std::uint32_t>();
+        if (!labels || !label_ips || labels->size() != label_ips->size()) {
+            return {};
+        }
+        for (auto ip : *label_ips) {
+            if (ip != ir::Body::nowhere && ip >= code->size()) {
+                return {};
+            }
+        }
+        entry.code = *code;
+        entry.labels = *labels;
+        entry.label_ips = *label_ips;
+
+        // Operands are checked once here so that nothing downstream can
+        // index past a table of a damaged cache
+        for (auto instr : entry.code) {
+            bool fits{true};
+            switch (instr.kind) {
+            case ir::Instruction::PushStr:
+                fits = instr.operand < entry.strings.size();
+                break;
+            case ir::Instruction::Call:
+                fits = id_of(instr.operand).has_value();
+                break;
+            case ir::Instruction::JumpTrue:
+            case ir::Instruction::Goto:
+            case ir::Instruction::Label:
+                fits = instr.operand < entry.labels.size();
+                break;
+            case ir::Instruction::PushInt:
+            case ir::Instruction::PushFloat:
+            case ir::Instruction::PushChar:
+            case ir::Instruction::Exit:
+                break;
+            default:
+                fits = false;
+            }
+            if (!fits) {
+                return {};
+            }
+        }
+        if (!same_ids) {
+            auto &copy = cache.renumbered.emplace_back(entry.code.begin(),
+                                                       entry.code.end());
+            for (auto &instr : copy) {
+                if (instr.kind == ir::Instruction::Call) {
+                    instr = ir::Instruction::call(*id_of(instr.operand));
+                }
+            }
+            entry.code = copy;
+        }
+        cache.entries.emplace_back(std::move(entry));
+    }
+    return cache;
+}
+
+traverser::Function ircache::Cache::function(std::size_t i) const {
+    auto const &entry = entries[i];
+    ir::Body body{};
+    body.code.assign(entry.code.begin(), entry.code.end());
+    body.strings.assign(entry.strings.begin(), entry.strings.end());
+    body.labels.assign(entry.labels.begin(), entry.labels.end());
+    body.label_ips.assign(entry.label_ips.begin(), entry.label_ips.end());
+    return traverser::Function{entry.name, entry.args, entry.rets,
+                               std::move(body)};
+}
+
+std::vector<traverser::Function> ircache::Cache::functions() const {
+    std::vector<traverser::Function> fns{};
+    fns.reserve(entries.size());
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        fns.emplace_back(function(i));
+    }
+    return fns;
+}
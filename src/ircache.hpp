@@ -0,0 +1,75 @@
+#pragma once
+
+#include "ir.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "symbols.hpp"
+#include "traverser.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Traversed functions saved next to their source, so a rebuild of an
+// unchanged file goes straight to checking. A cache file is, with every
+// integer in native byte order:
+//   header     magic "CHIR", version, source hash and size, build kind, and
+//              the number of symbols and of functions
+//   symbols    the names of Ids 0 to n - 1 of the process that wrote it
+//   functions  name, arguments and returns, then the IR body: the
+//              instructions as they are in memory, 8-byte aligned, followed
+//              by the strings, label sites and label positions
+// Instruction operands hold that process's Ids. A reader that interns the
+// same names in the same order gets the same Ids and checks the instruction
+// arrays where they are mapped; any other has them copied with the callees
+// renumbered. Handing a function out copies its body either way.
+namespace ircache {
+// Bumped whenever the layout or the meaning of the IR changes
+inline constexpr std::uint32_t version = 1;
+
+// What a cache is valid for: the exact source text, and whether every
+// function or only those reachable from main were traversed
+struct Key {
+    std::uint64_t hash;
+    std::uint64_t size;
+    bool library;
+
+    bool operator==(Key const &other) const = default;
+};
+
+Key key_of(std::string_view source, bool library);
+std::filesystem::path path_for(std::filesystem::path const &source);
+
+// Replaces the cache at path. A cache is only an optimization, so failing
+// to write one is not an error.
+void write(std::filesystem::path const &path, Key key,
+           std::vector<traverser::Function> const &fns);
+
+class Cache {
+    struct Entry {
+        symbols::Id name;
+        parser::Argument args;
+        parser::Return rets;
+        std::span<ir::Instruction const> code;
+        std::vector<std::string_view> strings;
+        std::span<ir::LabelSite const> labels;
+        std::span<std::uint32_t const> label_ips;
+    };
+    source::Source file{};
+    std::vector<Entry> entries{};
+    // Instructions with their callees renumbered, when this process's Ids
+    // differ from the writer's
+    std::vector<std::vector<ir::Instruction>> renumbered{};
+
+  public:
+    // Nothing when there is no cache at path or it is not valid for key
+    static std::optional<Cache> open(std::filesystem::path const &path,
+                                     Key key);
+
+    std::size_t size() const { return entries.size(); }
+    traverser::Function function(std::size_t i) const;
+    std::vector<traverser::Function> functions() const;
+};
+} // namespace ircache
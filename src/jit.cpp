@@ -0,0 +1,306 @@
+#include "jit.hpp"
+#include "builtins.hpp"
+#include "ir.hpp"
+#include "parser.hpp"
+#include "symbols.hpp"
+#include "traverser.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <sys/mman.h>
+#include <unordered_map>
+#include <utility>
+
+extern "C" {
+#include "core.h"
+}
+
+// The emitted code builds `ch_value`s in place, so it relies on this layout
+static_assert(sizeof(ch_value) == 32);
+static_assert(offsetof(ch_value, kind) == 0);
+static_assert(offsetof(ch_value, value) == 8);
+
+// Frame layout: [rbp-8] holds __istack, [rbp-16] a scratch slot
+struct Emitter {
+    std::vector<std::uint8_t> code{};
+
+    std::size_t here() const { return code.size(); }
+
+    void bytes(std::initializer_list<std::uint8_t> bs) {
+        code.insert(code.end(), bs);
+    }
+
+    void imm32(std::uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+            code.push_back((v >> (8 * i)) & 0xFF);
+    }
+
+    void imm64(std::uint64_t v) {
+        for (int i = 0; i < 8; ++i)
+            code.push_back((v >> (8 * i)) & 0xFF);
+    }
+
+    void patch32(std::size_t at, std::int32_t v) {
+        for (int i = 0; i < 4; ++i)
+            code[at + i] = (static_cast<std::uint32_t>(v) >> (8 * i)) & 0xFF;
+    }
+
+    // mov rax, imm64; call rax
+    void call_abs(void const *fn) {
+        bytes({0x48, 0xB8});
+        imm64(reinterpret_cast<std::uint64_t>(fn));
+        bytes({0xFF, 0xD0});
+    }
+
+    // lea rdi, [rbp-8]
+    void lea_stack_rdi() { bytes({0x48, 0x8D, 0x7D, 0xF8}); }
+
+    // sub rsp, 32 / add rsp, 32: room for one ch_value passed by value
+    void reserve_value() { bytes({0x48, 0x83, 0xEC, 0x20}); }
+    void release_value() { bytes({0x48, 0x83, 0xC4, 0x20}); }
+
+    // mov esi, n; mov edx, is_rest
+    void arg_counts(std::size_t n, bool is_rest) {
+        bytes({0xBE});
+        imm32(n);
+        bytes({0xBA});
+        imm32(is_rest);
+    }
+
+    // Pushes the ch_value currently at [rsp] onto __istack
+    void push_reserved() {
+        lea_stack_rdi();
+        call_abs(reinterpret_cast<void const *>(&ch_stk_push));
+        release_value();
+    }
+
+    void push_scalar(ch_value_kind kind, std::uint32_t payload) {
+        reserve_value();
+        // mov dword [rsp], kind
+        bytes({0xC7, 0x04, 0x24});
+        imm32(kind);
+        // mov dword [rsp+8], payload
+        bytes({0xC7, 0x44, 0x24, 0x08});
+        imm32(payload);
+        push_reserved();
+    }
+
+    // Returns the position of the rel32 operand
+    std::size_t rel32(std::initializer_list<std::uint8_t> opcode) {
+        bytes(opcode);
+        std::size_t at = here();
+        imm32(0);
+        return at;
+    }
+};
+
+struct Fixup {
+    std::size_t at;
+    ir::LabelId target;
+};
+
+struct CallFixup {
+    std::size_t at;
+    symbols::Id target;
+};
+
+// Runtime function of every builtin, with aliases going straight to the
+// function of the builtin they spell
+symbols::Table<ch_builtin_fn> builtin_table() {
+    symbols::Table<ch_builtin_fn> by_name{};
+    for (auto b = ch_builtins; b->name; ++b) {
+        by_name[symbols::intern(b->name)] = b->fn;
+    }
+    symbols::Table<ch_builtin_fn> table{};
+    for (auto const &builtin : builtins::table) {
+        auto id = builtins::id(builtin);
+        auto fn = by_name.find(builtins::target(id));
+        if (!fn || !*fn) {
+            throw backend::jit::JitError{std::format(
+                "Runtime has no function for builtin '{}'", builtin.name)};
+        }
+        table[id] = *fn;
+    }
+    return table;
+}
+
+void emit_fn(traverser::Function const &fn, Emitter &e,
+             std::deque<std::string> &strings,
+             symbols::Table<ch_builtin_fn> const &runtime,
+             std::vector<CallFixup> &calls) {
+    // Code offset of each label, once placed
+    std::vector<std::optional<std::size_t>> labels(fn.body.labels.size());
+    std::vector<Fixup> jumps{};
+
+    // push rbp; mov rbp, rsp; sub rsp, 16
+    e.bytes({0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x10});
+    // __istack = ch_stk_args(full, n, is_rest)
+    e.arg_counts(fn.args.args.size(),
+                 fn.args.kind == parser::Argument::Ellipses);
+    e.call_abs(reinterpret_cast<void const *>(&ch_stk_args));
+    // mov [rbp-8], rax
+    e.bytes({0x48, 0x89, 0x45, 0xF8});
+
+    for (auto &ir : fn.body) {
+        switch (ir.kind) {
+        case ir::Instruction::PushInt:
+            e.push_scalar(CH_VALK_INT, ir.operand);
+            break;
+        case ir::Instruction::PushFloat:
+            // The operand already holds the float's bits
+            e.push_scalar(CH_VALK_FLOAT, ir.operand);
+            break;
+        case ir::Instruction::PushChar:
+            e.push_scalar(CH_VALK_CHAR, ir.operand);
+            break;
+        case ir::Instruction::PushStr: {
+            auto &s = strings.emplace_back(fn.body.string(ir));
+            e.reserve_value();
+            // lea rdi, [rsp+8]; mov rsi, s
+            e.bytes({0x48, 0x8D, 0x7C, 0x24, 0x08, 0x48, 0xBE});
+            e.imm64(reinterpret_cast<std::uint64_t>(s.c_str()));
+            e.call_abs(reinterpret_cast<void const *>(&ch_str_new));
+            // mov dword [rsp], CH_VALK_STRING
+            e.bytes({0xC7, 0x04, 0x24});
+            e.imm32(CH_VALK_STRING);
+            e.push_reserved();
+            break;
+        }
+        case ir::Instruction::Call: {
+            auto callee = ir.callee();
+            e.lea_stack_rdi();
+            if (auto b = runtime.find(callee); b && *b) {
+                e.call_abs(reinterpret_cast<void const *>(*b));
+            } else {
+                calls.emplace_back(CallFixup{e.rel32({0xE8}), callee});
+            }
+            // mov rsi, rax
+            e.bytes({0x48, 0x89, 0xC6});
+            e.lea_stack_rdi();
+            e.call_abs(reinterpret_cast<void const *>(&ch_stk_append));
+            break;
+        }
+        case ir::Instruction::JumpTrue: {
+            e.reserve_value();
+            // mov rdi, rsp; lea rsi, [rbp-8]
+            e.bytes({0x48, 0x89, 0xE7, 0x48, 0x8D, 0x75, 0xF8});
+            e.call_abs(reinterpret_cast<void const *>(&ch_stk_pop));
+            // The popped value already sits where ch_valas_bool expects it
+            e.call_abs(reinterpret_cast<void const *>(&ch_valas_bool));
+            e.release_value();
+            // test al, al
+            e.bytes({0x84, 0xC0});
+            jumps.emplace_back(Fixup{e.rel32({0x0F, 0x85}), ir.label()});
+            break;
+        }
+        case ir::Instruction::Goto:
+            jumps.emplace_back(Fixup{e.rel32({0xE9}), ir.label()});
+            break;
+        case ir::Instruction::Label:
+            labels[ir::index(ir.label())] = e.here();
+            break;
+        case ir::Instruction::Exit:
+            e.lea_stack_rdi();
+            e.arg_counts(fn.rets.args.size(), fn.rets.rest.has_value());
+            e.call_abs(reinterpret_cast<void const *>(&ch_stk_args));
+            // mov [rbp-16], rax
+            e.bytes({0x48, 0x89, 0x45, 0xF0});
+            e.lea_stack_rdi();
+            e.call_abs(reinterpret_cast<void const *>(&ch_stk_delete));
+            // mov rax, [rbp-16]; leave; ret
+            e.bytes({0x48, 0x8B, 0x45, 0xF0, 0xC9, 0xC3});
+            break;
+        case ir::Instruction::GotoPos:
+        case ir::Instruction::LabelPos:
+            assert(false && "Unreachable instruction");
+            break;
+        }
+    }
+
+    for (auto &jump : jumps) {
+        auto const &label = labels[ir::index(jump.target)];
+        if (!label) {
+            throw backend::jit::JitError{std::format(
+                "In {}: jump to unknown label '{}'", symbols::name(fn.name),
+                fn.body.label_name(jump.target))};
+        }
+        e.patch32(jump.at, *label - (jump.at + 4));
+    }
+}
+
+backend::jit::Module backend::jit::make_jit(Program prog) {
+    Module module{};
+    Emitter e{};
+    std::vector<CallFixup> calls{};
+    symbols::Table<std::optional<std::size_t>> entries{};
+    auto runtime = builtin_table();
+
+    for (auto &fn : prog) {
+        entries[fn.name] = e.here();
+        module.entries.emplace(symbols::name(fn.name), e.here());
+        emit_fn(fn, e, module.strings, runtime, calls);
+    }
+
+    for (auto &call : calls) {
+        auto entry = entries.find(call.target);
+        if (!entry || !*entry) {
+            throw JitError{std::format("Call to unknown function '{}'",
+                                       symbols::name(call.target))};
+        }
+        e.patch32(call.at, **entry - (call.at + 4));
+    }
+
+    void *pages = mmap(nullptr, e.code.size(), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED) {
+        throw JitError{"Could not map memory for machine code"};
+    }
+    std::memcpy(pages, e.code.data(), e.code.size());
+    if (mprotect(pages, e.code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(pages, e.code.size());
+        throw JitError{"Could not make machine code executable"};
+    }
+    module.code = pages;
+    module.length = e.code.size();
+    return module;
+}
+
+backend::jit::Module::Module(Module &&other)
+    : code(std::exchange(other.code, nullptr)),
+      length(std::exchange(other.length, 0)),
+      entries(std::move(other.entries)), strings(std::move(other.strings)) {}
+
+backend::jit::Module &backend::jit::Module::operator=(Module &&other) {
+    if (this != &other) {
+        if (code) {
+            munmap(code, length);
+        }
+        code = std::exchange(other.code, nullptr);
+        length = std::exchange(other.length, 0);
+        entries = std::move(other.entries);
+        strings = std::move(other.strings);
+    }
+    return *this;
+}
+
+backend::jit::Module::~Module() {
+    if (code) {
+        munmap(code, length);
+    }
+}
+
+void backend::jit::Module::run(std::string const &name) {
+    auto entry = entries.find(name);
+    if (entry == entries.end()) {
+        throw JitError{std::format("No function named '{}'", name)};
+    }
+    auto fn = reinterpret_cast<ch_builtin_fn>(
+        static_cast<std::uint8_t *>(code) + entry->second);
+    ch_stack_node *stk = ch_stk_new();
+    ch_stack_node *rets = fn(&stk);
+    ch_stk_delete(&rets);
+    ch_stk_delete(&stk);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "traverser.hpp"
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace backend::jit {
+using Program = std::vector<traverser::Function>;
+
+struct JitError {
+    std::string what;
+};
+
+// Executable pages holding the machine code of a whole program.
+class Module {
+    void *code{nullptr};
+    std::size_t length{0};
+    std::unordered_map<std::string, std::size_t> entries{};
+    std::deque<std::string> strings{};
+
+    friend Module make_jit(Program prog);
+
+  public:
+    Module() = default;
+    Module(Module const &) = delete;
+    Module &operator=(Module const &) = delete;
+    Module(Module &&other);
+    Module &operator=(Module &&other);
+    ~Module();
+
+    std::size_t size() const { return length; }
+
+    // Calls a Charta function on an empty stack, dropping its results.
+    void run(std::string const &name);
+};
+
+Module make_jit(Program prog);
+}; // namespace backend::jit
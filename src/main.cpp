@@ -1,12 +1,12 @@
 #include "builder.hpp"
 #include "make_c.hpp"
 #include "parser.hpp"
+#include "server.hpp"
+#include "source.hpp"
 #include "traverser.hpp"
 #include "utf.hpp"
 #include <filesystem>
-#include <fstream>
 #include <print>
-#include <sstream>
 #include <string>
 #include <variant>
 
@@ -16,11 +16,27 @@ int main(int argc, char *argv[]) {
     std::filesystem::path exe_dir{
         std::filesystem::weakly_canonical(std::filesystem::path(argv[0]))
             .parent_path()};
-    std::ifstream file(argv[1]);
-    std::ostringstream ss;
-    ss << file.rdbuf();
-    std::string input{ss.str()};
-    builder::Builder b = builder::Builder(input, argv[1]);
+    if (std::string{argv[1]} == "-serve") {
+        try {
+            server::serve(argc > 2 ? std::filesystem::path{argv[2]}
+                                   : server::socket_path(),
+                          exe_dir);
+        } catch (server::ServerError e) {
+            std::println("Err: {}", e.what);
+            return 1;
+        }
+    }
+    source::Source input{};
+    try {
+        input = source::Source::map(argv[1]);
+    } catch (source::SourceError e) {
+        std::println("Err: {}", e.what);
+        return 1;
+    }
+    builder::Builder b = builder::Builder(std::move(input), argv[1]);
+    bool jit{false};
+    bool shared{false};
+    bool watch{false};
     for (std::size_t i = 1; i < argc; ++i) {
         std::string arg{argv[i]};
         if (arg == "-ir") {
@@ -31,7 +47,39 @@ int main(int argc, char *argv[]) {
             b.cmd();
         } else if (arg == "-type") {
             b.type();
+        } else if (arg == "-llvm") {
+            b.llvm();
+        } else if (arg == "-asm") {
+            b.assembly();
+        } else if (arg == "-pgo-gen") {
+            b.profile_generate();
+        } else if (arg == "-pgo-use") {
+            b.profile_use();
+        } else if (arg == "-cache") {
+            b.cached();
+        } else if (arg == "-stream") {
+            b.streamed();
+        } else if (arg == "-watch" || arg == "--watch") {
+            watch = true;
+        } else if (arg == "-jit") {
+            jit = true;
+        } else if (arg == "-shared") {
+            b.shared();
+            shared = !shared;
         }
     }
-    b.build(exe_dir, "out_" + std::filesystem::path(argv[1]).stem().string());
+    auto stem = std::filesystem::path(argv[1]).stem().string();
+    std::string out_file{shared ? "lib" + stem + ".so" : "out_" + stem};
+    try {
+        if (jit) {
+            b.run();
+        } else if (watch) {
+            b.watch(exe_dir, out_file);
+        } else {
+            b.build(exe_dir, out_file);
+        }
+    } catch (builder::BuildError e) {
+        std::println("Err: {}", e.what);
+        return 1;
+    }
 }
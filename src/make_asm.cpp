@@ -0,0 +1,565 @@
+#include "make_asm.hpp"
+#include "builtins.hpp"
+#include "checks.hpp"
+#include "ir.hpp"
+#include "mangler.hpp"
+#include "parser.hpp"
+#include "symbols.hpp"
+#include "traverser.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "core.h"
+}
+
+// Values are built in place on the native stack before ch_stk_push, and
+// read straight out of the top node when their kind is known
+static_assert(sizeof(ch_value) == 32);
+static_assert(offsetof(ch_value, kind) == 0);
+static_assert(offsetof(ch_value, value) == 8);
+static_assert(offsetof(ch_stack_node, next) == 32);
+
+// Frame layout, relative to %rbp:
+//   -8   saved %rbx
+//   -16  saved %r12
+//   -24  saved %r13
+//   -32  saved %r14
+//   -40  saved %r15
+//   -48  __istack
+// %rbx holds &__istack for the whole function, so every runtime call gets
+// its stack argument with a register move, and %r12 carries results across
+// calls instead of a spill slot. %r13 to %r15 hold scalars that have not
+// been pushed yet, see AsmEmitter.
+static const std::string prologue{"\tpushq %rbp\n"
+                                  "\tmovq %rsp, %rbp\n"
+                                  "\tpushq %rbx\n"
+                                  "\tpushq %r12\n"
+                                  "\tpushq %r13\n"
+                                  "\tpushq %r14\n"
+                                  "\tpushq %r15\n"
+                                  "\tsubq $8, %rsp\n"
+                                  "\tleaq -48(%rbp), %rbx\n"};
+
+static const std::string epilogue{"\tleaq -40(%rbp), %rsp\n"
+                                  "\tpopq %r15\n"
+                                  "\tpopq %r14\n"
+                                  "\tpopq %r13\n"
+                                  "\tpopq %r12\n"
+                                  "\tpopq %rbx\n"
+                                  "\tpopq %rbp\n"
+                                  "\tret\n"};
+
+std::string asm_bytes(std::string const &s) {
+    std::string out{"\""};
+    for (unsigned char c : s) {
+        if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\') {
+            out += c;
+        } else {
+            out += std::format("\\{:03o}", static_cast<unsigned>(c));
+        }
+    }
+    return out + "\"";
+}
+
+// How an open-coded builtin is emitted: int arithmetic into the register
+// of its first operand, an int compare into a setcc, or an SSE operation on
+// %xmm0 and %xmm1
+enum class Form { IntArith, IntCompare, FloatArith, FloatCompare };
+
+struct AsmOp {
+    std::string_view name;
+    checks::Type::Kind operand;
+    Form form;
+    // The instruction, or for compares what turns the flags into %al
+    std::string_view instr;
+    // Compares the operands the other way round, so that unordered floats
+    // come out false
+    bool swap{false};
+};
+
+// Open-coded forms of the inlinable builtins, by the name of the builtin
+// that implements them
+// clang-format off
+static constexpr AsmOp inline_ops[] = {
+    {"+",  checks::Type::Int,   Form::IntArith,     "addl"},
+    {"-",  checks::Type::Int,   Form::IntArith,     "subl"},
+    {"*",  checks::Type::Int,   Form::IntArith,     "imull"},
+    {"=",  checks::Type::Int,   Form::IntCompare,   "\tsete %al\n"},
+    {"!=", checks::Type::Int,   Form::IntCompare,   "\tsetne %al\n"},
+    {"=",  checks::Type::Char,  Form::IntCompare,   "\tsete %al\n"},
+    {"!=", checks::Type::Char,  Form::IntCompare,   "\tsetne %al\n"},
+    {"+",  checks::Type::Float, Form::FloatArith,   "addss"},
+    {"-",  checks::Type::Float, Form::FloatArith,   "subss"},
+    {"*",  checks::Type::Float, Form::FloatArith,   "mulss"},
+    {"/",  checks::Type::Float, Form::FloatArith,   "divss"},
+    {"=",  checks::Type::Float, Form::FloatCompare, "\tsete %al\n\tsetnp %cl\n\tandb %cl, %al\n"},
+    {"!=", checks::Type::Float, Form::FloatCompare, "\tsetne %al\n\tsetp %cl\n\torb %cl, %al\n"},
+    {"<",  checks::Type::Float, Form::FloatCompare, "\tseta %al\n", true},
+    {">",  checks::Type::Float, Form::FloatCompare, "\tseta %al\n"},
+    {"<=", checks::Type::Float, Form::FloatCompare, "\tsetae %al\n", true},
+    {">=", checks::Type::Float, Form::FloatCompare, "\tsetae %al\n"},
+};
+// clang-format on
+
+// The runtime orders ints by comparing them as floats
+static constexpr std::string_view int_as_float[] = {"<", ">", "<=", ">="};
+
+static bool is_scalar(checks::Type::Kind kind) {
+    return kind == checks::Type::Int || kind == checks::Type::Float ||
+           kind == checks::Type::Bool || kind == checks::Type::Char;
+}
+
+static int value_kind(checks::Type::Kind kind) {
+    switch (kind) {
+    case checks::Type::Int:
+        return CH_VALK_INT;
+    case checks::Type::Float:
+        return CH_VALK_FLOAT;
+    case checks::Type::Bool:
+        return CH_VALK_BOOL;
+    case checks::Type::Char:
+        return CH_VALK_CHAR;
+    default:
+        assert(false && "Only scalars are kept in registers");
+        return CH_VALK_INT;
+    }
+}
+
+// Emits one function. Constants and the results of open-coded builtins are
+// kept in the emitter as pending slots instead of being pushed: in
+// registers %r13 to %r15, which calls preserve, or as immediates. They sit
+// on top of the runtime stack in order, and are pushed before anything
+// else can look at the stack: a call into the runtime or another function,
+// a jump or label, or the exit. Open-coded builtins also take their
+// operands straight from the top nodes when the checker proved their kinds,
+// which it only does for values this function made: a parameter declared
+// int may still hold any member of a union.
+class AsmEmitter {
+    struct Slot {
+        checks::Type::Kind kind;
+        // Register holding the payload, or none for the constant in bits
+        std::optional<std::size_t> reg{};
+        std::uint32_t bits{0};
+    };
+
+    static constexpr std::array<std::string_view, 3> regs{"%r13d", "%r14d",
+                                                          "%r15d"};
+    // Deep enough for the operands of any builtin, shallow enough that a
+    // long run of constants is not all pushed at once at the next call
+    static constexpr std::size_t max_pending = 8;
+
+    traverser::Function const &fn;
+    std::size_t index;
+    std::vector<checks::Fact> const *facts;
+    std::string &out;
+    std::string &rodata;
+    std::size_t &string_counter;
+    std::vector<Slot> pending{};
+    std::array<bool, regs.size()> used{};
+
+    checks::Fact fact(std::size_t ip) const {
+        if (!facts || ip >= facts->size())
+            return {};
+        return (*facts)[ip];
+    }
+
+    std::string label(ir::LabelId id) const {
+        return std::format(".L{}_{}", index, fn.body.label_name(id));
+    }
+
+    void release(Slot const &slot) {
+        if (slot.reg) {
+            used[*slot.reg] = false;
+        }
+    }
+
+    void push(Slot const &slot) {
+        auto payload = slot.reg ? std::string{regs[*slot.reg]}
+                                : std::format("${}", slot.bits);
+        out += std::format("\tsubq $32, %rsp\n"
+                           "\tmovl ${}, (%rsp)\n"
+                           "\tmovl {}, 8(%rsp)\n"
+                           "\tmovq %rbx, %rdi\n"
+                           "\tcall ch_stk_push@PLT\n"
+                           "\taddq $32, %rsp\n",
+                           value_kind(slot.kind), payload);
+    }
+
+    // Pushes the deepest pending slot, which keeps the order of the rest
+    void push_bottom() {
+        push(pending.front());
+        release(pending.front());
+        pending.erase(pending.begin());
+    }
+
+    void flush() {
+        for (auto const &slot : pending) {
+            push(slot);
+            release(slot);
+        }
+        pending.clear();
+    }
+
+    std::size_t grab() {
+        while (true) {
+            auto free = std::ranges::find(used, false);
+            if (free != used.end()) {
+                *free = true;
+                return free - used.begin();
+            }
+            push_bottom();
+        }
+    }
+
+    void keep(Slot slot) {
+        if (pending.size() == max_pending) {
+            push_bottom();
+        }
+        pending.emplace_back(slot);
+    }
+
+    // Kind of the value depth places below the top, as far as it is known
+    std::optional<checks::Type::Kind> kind_at(std::size_t depth,
+                                              checks::Fact const &f) const {
+        if (depth < pending.size()) {
+            return pending[pending.size() - 1 - depth].kind;
+        }
+        // The checker's facts are about the whole stack, pending slots
+        // included
+        return depth == 0 ? f.top : depth == 1 ? f.below : std::nullopt;
+    }
+
+    // Removes the top value, loading it from the runtime stack when nothing
+    // is pending. Only called once kind_at proved it a scalar, since the
+    // node's kind tag is not checked.
+    Slot take(checks::Type::Kind kind) {
+        if (!pending.empty()) {
+            auto slot = pending.back();
+            pending.pop_back();
+            return slot;
+        }
+        auto reg = grab();
+        out += std::format("\tmovq (%rbx), %rdi\n"
+                           "\t{} 8(%rdi), {}\n"
+                           "\tmovq 32(%rdi), %rax\n"
+                           "\tmovq %rax, (%rbx)\n"
+                           "\tcall free@PLT\n",
+                           kind == checks::Type::Bool ? "movzbl" : "movl",
+                           regs[reg]);
+        return Slot{kind, reg};
+    }
+
+    std::string_view in_register(Slot &slot) {
+        if (!slot.reg) {
+            slot.reg = grab();
+            out += std::format("\tmovl ${}, {}\n", slot.bits, regs[*slot.reg]);
+        }
+        return regs[*slot.reg];
+    }
+
+    std::string operand(Slot const &slot) const {
+        return slot.reg ? std::string{regs[*slot.reg]}
+                        : std::format("${}", slot.bits);
+    }
+
+    void to_xmm(Slot const &slot, bool widen, std::string_view xmm) {
+        if (!slot.reg) {
+            auto bits = widen ? std::bit_cast<std::uint32_t>(static_cast<float>(
+                                    std::bit_cast<int>(slot.bits)))
+                              : slot.bits;
+            out += std::format("\tmovl ${}, %eax\n"
+                               "\tmovd %eax, {}\n",
+                               bits, xmm);
+        } else if (widen) {
+            out += std::format("\tcvtsi2ssl {}, {}\n", regs[*slot.reg], xmm);
+        } else {
+            out += std::format("\tmovd {}, {}\n", regs[*slot.reg], xmm);
+        }
+    }
+
+    bool try_inline(symbols::Id id, checks::Fact const &f) {
+        auto builtin = builtins::find(id);
+        if (!builtin || !(builtin->flags & builtins::Inlinable))
+            return false;
+        auto top = kind_at(0, f);
+        auto below = kind_at(1, f);
+        if (!top || !below || *top != *below)
+            return false;
+        auto callee = builtin->runtime;
+        bool widen = *top == checks::Type::Int &&
+                     std::ranges::find(int_as_float, callee) !=
+                         std::end(int_as_float);
+        auto op = std::ranges::find_if(inline_ops, [&](auto const &op) {
+            return op.name == callee &&
+                   op.operand == (widen ? checks::Type::Float : *top);
+        });
+        if (op == std::end(inline_ops))
+            return false;
+
+        auto b = take(*top);
+        auto a = take(*below);
+        switch (op->form) {
+        case Form::IntArith: {
+            auto dest = in_register(a);
+            out += std::format("\t{} {}, {}\n", op->instr, operand(b), dest);
+            release(b);
+            keep(a);
+            break;
+        }
+        case Form::IntCompare: {
+            auto dest = in_register(a);
+            out += std::format("\tcmpl {}, {}\n", operand(b), dest);
+            out += op->instr;
+            out += std::format("\tmovzbl %al, {}\n", dest);
+            release(b);
+            keep(Slot{checks::Type::Bool, a.reg});
+            break;
+        }
+        case Form::FloatArith:
+        case Form::FloatCompare: {
+            // Taken before anything is loaded, since pushing a slot to make
+            // room calls into the runtime
+            auto dest = a.reg ? *a.reg : grab();
+            to_xmm(a, widen, "%xmm0");
+            to_xmm(b, widen, "%xmm1");
+            release(b);
+            if (op->form == Form::FloatArith) {
+                out += std::format("\t{} %xmm1, %xmm0\n"
+                                   "\tmovd %xmm0, {}\n",
+                                   op->instr, regs[dest]);
+                keep(Slot{checks::Type::Float, dest});
+            } else {
+                out += op->swap ? "\tucomiss %xmm0, %xmm1\n"
+                                : "\tucomiss %xmm1, %xmm0\n";
+                out += op->instr;
+                out += std::format("\tmovzbl %al, {}\n", regs[dest]);
+                keep(Slot{checks::Type::Bool, dest});
+            }
+            break;
+        }
+        }
+        return true;
+    }
+
+    // A pure builtin whose signature only names generics moves its
+    // arguments around without looking at them, so scalars are shuffled as
+    // slots. Arguments and results are listed top first.
+    bool try_shuffle(symbols::Id id, checks::Fact const &f) {
+        auto builtin = builtins::find(id);
+        if (!builtin || !(builtin->flags & builtins::Pure) ||
+            builtin->takes_all)
+            return false;
+        auto generic = [](builtins::Slot slot) {
+            return slot == builtins::Slot::A || slot == builtins::Slot::B ||
+                   slot == builtins::Slot::C;
+        };
+        if (!std::ranges::all_of(builtin->args, generic) ||
+            !std::ranges::all_of(builtin->rets, generic))
+            return false;
+        std::array<checks::Type::Kind, 3> kinds{};
+        for (std::size_t depth = 0; depth < builtin->args.size; ++depth) {
+            auto kind = kind_at(depth, f);
+            if (!kind || !is_scalar(*kind))
+                return false;
+            kinds[depth] = *kind;
+        }
+
+        std::array<Slot, 3> args{};
+        for (std::size_t depth = 0; depth < builtin->args.size; ++depth) {
+            args[depth] = take(kinds[depth]);
+        }
+        // The generic each argument is, and whether it was handed out yet
+        auto arg_of = [&](builtins::Slot slot) {
+            return std::ranges::find(builtin->args, slot) -
+                   builtin->args.begin();
+        };
+        std::array<bool, 3> given{};
+        std::array<Slot, 3> rets{};
+        for (std::size_t k = 0; k < builtin->rets.size; ++k) {
+            auto i = arg_of(builtin->rets.at[k]);
+            if (!given[i]) {
+                given[i] = true;
+                rets[k] = args[i];
+            } else if (args[i].reg) {
+                auto reg = grab();
+                out += std::format("\tmovl {}, {}\n", regs[*args[i].reg],
+                                   regs[reg]);
+                rets[k] = Slot{args[i].kind, reg};
+            } else {
+                rets[k] = args[i];
+            }
+        }
+        for (std::size_t i = 0; i < builtin->args.size; ++i) {
+            if (!given[i]) {
+                release(args[i]);
+            }
+        }
+        for (std::size_t k = builtin->rets.size; k-- > 0;) {
+            keep(rets[k]);
+        }
+        return true;
+    }
+
+    void emit_instr(std::size_t ip) {
+        auto const &ir = fn.body[ip];
+        switch (ir.kind) {
+        case ir::Instruction::PushInt:
+            keep(Slot{checks::Type::Int, {}, ir.operand});
+            break;
+        case ir::Instruction::PushFloat:
+            // The operand already holds the float's bits
+            keep(Slot{checks::Type::Float, {}, ir.operand});
+            break;
+        case ir::Instruction::PushChar:
+            keep(Slot{checks::Type::Char, {}, ir.operand});
+            break;
+        case ir::Instruction::PushStr: {
+            flush();
+            auto str = std::format(".Lstr{}", string_counter++);
+            rodata += std::format("{}:\n\t.asciz {}\n", str,
+                                  asm_bytes(fn.body.string(ir)));
+            out += std::format("\tsubq $32, %rsp\n"
+                               "\tleaq 8(%rsp), %rdi\n"
+                               "\tleaq {}(%rip), %rsi\n"
+                               "\tcall ch_str_new@PLT\n"
+                               "\tmovl ${}, (%rsp)\n"
+                               "\tmovq %rbx, %rdi\n"
+                               "\tcall ch_stk_push@PLT\n"
+                               "\taddq $32, %rsp\n",
+                               str, static_cast<int>(CH_VALK_STRING));
+            break;
+        }
+        case ir::Instruction::Call:
+            if (try_inline(ir.callee(), fact(ip)) ||
+                try_shuffle(ir.callee(), fact(ip)))
+                break;
+            flush();
+            out += std::format("\tmovq %rbx, %rdi\n"
+                               "\tcall {}@PLT\n"
+                               "\tmovq %rbx, %rdi\n"
+                               "\tmovq %rax, %rsi\n"
+                               "\tcall ch_stk_append@PLT\n",
+                               symbols::mangled(builtins::target(ir.callee())));
+            break;
+        case ir::Instruction::JumpTrue:
+            if (kind_at(0, fact(ip)) == checks::Type::Bool) {
+                // Both ways out start with everything pushed
+                auto cond = take(checks::Type::Bool);
+                auto reg = in_register(cond);
+                flush();
+                out += std::format("\ttestl {0}, {0}\n"
+                                   "\tjnz {1}\n",
+                                   reg, label(ir.label()));
+                release(cond);
+                break;
+            }
+            flush();
+            // The popped value is left exactly where ch_valas_bool reads it
+            out += std::format("\tsubq $32, %rsp\n"
+                               "\tmovq %rsp, %rdi\n"
+                               "\tmovq %rbx, %rsi\n"
+                               "\tcall ch_stk_pop@PLT\n"
+                               "\tcall ch_valas_bool@PLT\n"
+                               "\taddq $32, %rsp\n"
+                               "\ttestb %al, %al\n"
+                               "\tjnz {}\n",
+                               label(ir.label()));
+            break;
+        case ir::Instruction::Goto:
+            flush();
+            out += std::format("\tjmp {}\n", label(ir.label()));
+            break;
+        case ir::Instruction::Label:
+            flush();
+            out += label(ir.label()) + ":\n";
+            break;
+        case ir::Instruction::Exit:
+            flush();
+            out += std::format("\tmovq %rbx, %rdi\n"
+                               "\tmovl ${}, %esi\n"
+                               "\tmovl ${}, %edx\n"
+                               "\tcall ch_stk_args@PLT\n"
+                               "\tmovq %rax, %r12\n"
+                               "\tmovq %rbx, %rdi\n"
+                               "\tcall ch_stk_delete@PLT\n"
+                               "\tmovq %r12, %rax\n",
+                               fn.rets.args.size(),
+                               static_cast<int>(fn.rets.rest.has_value()));
+            out += epilogue;
+            break;
+        case ir::Instruction::GotoPos:
+        case ir::Instruction::LabelPos:
+            assert(false && "Unreachable instruction");
+            break;
+        }
+    }
+
+  public:
+    AsmEmitter(traverser::Function const &fn, std::size_t index,
+              std::vector<checks::Fact> const *facts, std::string &out,
+              std::string &rodata, std::size_t &string_counter)
+        : fn(fn), index(index), facts(facts), out(out), rodata(rodata),
+          string_counter(string_counter) {}
+
+    void emit() {
+        for (std::size_t ip = 0; ip < fn.body.size(); ++ip) {
+            emit_instr(ip);
+        }
+    }
+};
+
+std::string backend::x86::make_asm(Program prog, checks::Facts const &facts) {
+    std::string text{};
+    std::string rodata{};
+    std::size_t string_counter{0};
+    for (std::size_t i = 0; i < prog.size(); ++i) {
+        auto const &fn = prog[i];
+        auto const &name = symbols::mangled(fn.name);
+        text += std::format("\t.globl {0}\n"
+                            "\t.type {0}, @function\n"
+                            "{0}:\n",
+                            name);
+        text += prologue;
+        // __istack = ch_stk_args(full, n, is_rest)
+        text += std::format("\tmovl ${}, %esi\n"
+                            "\tmovl ${}, %edx\n"
+                            "\tcall ch_stk_args@PLT\n"
+                            "\tmovq %rax, (%rbx)\n",
+                            fn.args.args.size(),
+                            static_cast<int>(fn.args.kind ==
+                                             parser::Argument::Ellipses));
+        AsmEmitter(fn, i, facts.find(fn.name), text, rodata, string_counter)
+            .emit();
+        text += std::format("\t.size {0}, .-{0}\n\n", name);
+    }
+
+    std::string full{};
+    full += "\t.section .rodata\n" + rodata;
+    full += "\n\t.text\n" + text;
+    full += "\t.globl main\n"
+            "\t.type main, @function\n"
+            "main:\n"
+            "\tpushq %rbp\n"
+            "\tmovq %rsp, %rbp\n"
+            "\tsubq $16, %rsp\n"
+            "\tmovq $0, -8(%rbp)\n"
+            "\tleaq -8(%rbp), %rdi\n"
+            "\tcall " +
+            mangle("main") +
+            "\n"
+            "\txorl %eax, %eax\n"
+            "\tleave\n"
+            "\tret\n"
+            "\t.size main, .-main\n";
+    full += "\t.section .note.GNU-stack,\"\",@progbits\n";
+    return full;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "checks.hpp"
+#include "traverser.hpp"
+#include <string>
+#include <vector>
+
+namespace backend::x86 {
+using Program = std::vector<traverser::Function>;
+std::string make_asm(Program prog, checks::Facts const &facts);
+}; // namespace backend::x86
@@ -1,13 +1,16 @@
 #include "make_c.hpp"
+#include "builtins.hpp"
 #include "ir.hpp"
-#include "mangler.hpp"
 #include "parser.hpp"
+#include "symbols.hpp"
 #include "traverser.hpp"
 #include "utf.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <iomanip>
+#include <optional>
 #include <print>
 #include <sstream>
 #include <stdexcept>
@@ -37,49 +40,140 @@ std::string name_of(parser::TypeSig type) {
 }
 
 std::string get_temp() {
-    static std::size_t temp_counter = 0;
+    // Builds may run side by side in one process
+    static std::atomic<std::size_t> temp_counter{0};
     return "__itemp" + std::to_string(temp_counter++);
 }
 
-void emit_instrs(traverser::Function fn, std::string &out) {
+// Leaf functions up to this many instructions are inlined into hot callers
+static constexpr std::size_t inline_limit{64};
+
+struct Context {
+    backend::c::Options const &opts;
+    symbols::Table<traverser::Function const *> inlinable{};
+    std::vector<std::string> counters{};
+
+    std::size_t counter(std::string name) {
+        counters.emplace_back(std::move(name));
+        return counters.size() - 1;
+    }
+};
+
+// Where an instruction sequence is being emitted: the function's own body,
+// or a copy inlined into a caller
+struct Site {
+    std::string prefix{};
+    std::optional<std::string> exit{};
+};
+
+void emit_instrs(traverser::Function const &fn, std::string &out,
+                 Context &ctx, Site const &site);
+
+void emit_inline(traverser::Function const &callee, std::string &out,
+                 Context &ctx) {
+    auto id = get_temp();
+    Site site{id + "_", id + "_end"};
+    std::string ret = id + "_ret";
+    out += "ch_stack_node *" + ret + ";\n";
+    out += "{\n";
+    out += "ch_stack_node **__ifull = &__istack;\n";
+    out += "ch_stack_node *__istack = ch_stk_args(__ifull, " +
+           std::to_string(callee.args.args.size()) + ", " +
+           std::to_string(callee.args.kind == parser::Argument::Ellipses) +
+           ");\n";
+    emit_instrs(callee, out, ctx, site);
+    out += "}\n";
+    out += *site.exit + ":\n";
+    out += "ch_stk_append(&__istack, " + ret + ");\n";
+}
+
+void emit_jump_true(traverser::Function const &fn, std::string const &label,
+                    std::string &out, Context &ctx, Site const &site) {
+    std::string target = site.prefix + label;
+    auto const &fname = symbols::name(fn.name);
+    if (ctx.opts.instrument) {
+        auto total = ctx.counter("br " + fname + " " + label + " total");
+        auto taken = ctx.counter("br " + fname + " " + label + " taken");
+        out += "{ char __icond = ch_valas_bool(ch_stk_pop(&__istack));\n";
+        out += "++__iprof[" + std::to_string(total) + "];\n";
+        out += "if (__icond) { ++__iprof[" + std::to_string(taken) +
+               "]; goto " + target + "; } }\n";
+        return;
+    }
+    std::string cond{"ch_valas_bool(ch_stk_pop(&__istack))"};
+    if (ctx.opts.profile) {
+        if (auto b = ctx.opts.profile->branch(fname, label);
+            b && b->total > 0) {
+            // Lay out the likely side as the fallthrough
+            if (b->taken * 10 >= b->total * 9) {
+                cond = "__builtin_expect(" + cond + ", 1)";
+            } else if (b->taken * 10 <= b->total) {
+                cond = "__builtin_expect(" + cond + ", 0)";
+            }
+        }
+    }
+    out += "if (" + cond + ") goto " + target + ";\n";
+}
+
+// Labels only reached through branches that were never taken are moved out
+// of the hot path
+bool is_cold_label(traverser::Function const &fn, std::string const &label,
+                   Context const &ctx) {
+    if (!ctx.opts.profile)
+        return false;
+    auto b = ctx.opts.profile->branch(symbols::name(fn.name), label);
+    return b && b->total > 0 && b->taken == 0;
+}
+
+void emit_instrs(traverser::Function const &fn, std::string &out,
+                 Context &ctx, Site const &site) {
     for (auto &ir : fn.body) {
         switch (ir.kind) {
         case ir::Instruction::PushInt:
             out += "ch_stk_push(&__istack, ch_valof_int(" +
-                   std::to_string(std::get<int>(ir.value)) + "));\n";
+                   std::to_string(ir.int_value()) + "));\n";
             break;
         case ir::Instruction::PushFloat:
             out += "ch_stk_push(&__istack, ch_valof_float(" +
-                   std::to_string(std::get<float>(ir.value)) + "));\n";
+                   std::to_string(ir.float_value()) + "));\n";
             break;
         case ir::Instruction::PushChar:
             out += "ch_stk_push(&__istack, ch_valof_char(" +
-                   std::to_string(std::get<char32_t>(ir.value)) + "));\n";
+                   std::to_string(ir.char_value()) + "));\n";
             break;
         case ir::Instruction::PushStr: {
             out += "ch_stk_push(&__istack, ch_valof_string(ch_str_new(" +
-                   parser::quote_str(std::get<std::string>(ir.value)) +
+                   parser::quote_str(fn.body.string(ir)) +
                    ")));\n";
             break;
         }
         case ir::Instruction::Call: {
+            auto callee = ir.callee();
+            if (auto inl = ctx.inlinable.find(callee); inl && *inl) {
+                emit_inline(**inl, out, ctx);
+                break;
+            }
             std::string tmp = get_temp();
             out += "ch_stack_node*" + tmp + "=" +
-                   mangle(std::get<std::string>(ir.value)) + "(&__istack);\n";
+                   symbols::mangled(builtins::target(callee)) +
+                   "(&__istack);\n";
             out += "ch_stk_append(&__istack, " + tmp + ");\n";
             break;
         }
         case ir::Instruction::JumpTrue: {
-            out += "if (ch_valas_bool(ch_stk_pop(&__istack))) goto " +
-                   std::get<std::string>(ir.value) + ";\n";
+            emit_jump_true(fn, fn.body.label_name(ir.label()), out, ctx, site);
             break;
         }
         case ir::Instruction::Goto: {
-            out += "goto " + std::get<std::string>(ir.value) + ";\n";
+            out += "goto " + site.prefix + fn.body.label_name(ir.label()) +
+                   ";\n";
             break;
         }
         case ir::Instruction::Label: {
-            out += std::get<std::string>(ir.value) + ":\n";
+            auto label = fn.body.label_name(ir.label());
+            out += site.prefix + label + ":";
+            out += is_cold_label(fn, label, ctx) ? " __attribute__((cold));\n"
+                                                 : "\n";
             break;
         }
         case ir::Instruction::Exit: {
@@ -88,7 +182,12 @@ void emit_instrs(traverser::Function fn, std::string &out) {
                    std::to_string(fn.rets.args.size()) + ", " +
                    std::to_string(fn.rets.rest.has_value()) + ");\n";
             out += "ch_stk_delete(&__istack);\n";
-            out += "return " + tmp + ";\n";
+            if (site.exit) {
+                out += site.prefix + "ret = " + tmp + ";\n";
+                out += "goto " + *site.exit + ";\n";
+            } else {
+                out += "return " + tmp + ";\n";
+            }
             break;
         }
         case ir::Instruction::GotoPos:
@@ -99,22 +198,201 @@ void emit_instrs(traverser::Function fn, std::string &out) {
     }
 }
 
-std::string backend::c::make_c(Program prog) {
+// Hot leaf functions are inlined into their callers
+void collect_inlinable(backend::c::Program const &prog, Context &ctx) {
+    if (!ctx.opts.profile)
+        return;
+    symbols::Table<traverser::Function const *> user{};
+    for (auto &fn : prog) {
+        user[fn.name] = &fn;
+    }
+    auto hottest = ctx.opts.profile->hottest();
+    for (auto &fn : prog) {
+        auto const &name = symbols::name(fn.name);
+        auto calls = ctx.opts.profile->calls_of(name);
+        bool is_hot = calls > 0 && calls * 100 >= hottest;
+        bool is_leaf = std::none_of(
+            fn.body.begin(), fn.body.end(), [&](ir::Instruction const &ir) {
+                if (ir.kind != ir::Instruction::Call)
+                    return false;
+                auto called = user.find(ir.callee());
+                return called && *called;
+            });
+        if (name != "main" && is_hot && is_leaf &&
+            fn.body.size() <= inline_limit) {
+            ctx.inlinable[fn.name] = &fn;
+        }
+    }
+}
+
+std::string signature(traverser::Function const &fn, Context const &ctx) {
+    std::string attrs{};
+    if (ctx.opts.profile &&
+        ctx.opts.profile->calls_of(symbols::name(fn.name)) == 0) {
+        attrs = "__attribute__((cold)) ";
+    }
+    return attrs + "ch_stack_node *" + symbols::mangled(fn.name) +
+           "(ch_stack_node **__ifull)";
+}
+
+std::string profile_writer(Context const &ctx) {
+    std::string out{};
+    auto n = std::to_string(ctx.counters.size());
+    out += "static char const *__iprof_names[" + n + "] = {\n";
+    for (auto &name : ctx.counters) {
+        out += parser::quote_str(name) + ",\n";
+    }
+    out += "};\n";
+    // Counts from earlier runs of the same build are merged in
+    out += "static void __iprof_dump(void) {\n";
+    out += "FILE *f = fopen(" + parser::quote_str(*ctx.opts.instrument) +
+           ", \"r\");\n";
+    out += "size_t n = 0;\n";
+    out += "if (f && fscanf(f, \"charta-profile 1 %zu\", &n) == 1 && n == " +
+           n + ") {\n";
+    out += "for (size_t i = 0; i < n; ++i) {\n";
+    out += "unsigned long c;\n";
+    out += "if (fscanf(f, \"%lu %*[^\\n]\", &c) != 1) break;\n";
+    out += "__iprof[i] += c;\n";
+    out += "}\n";
+    out += "}\n";
+    out += "if (f) fclose(f);\n";
+    out += "f = fopen(" + parser::quote_str(*ctx.opts.instrument) +
+           ", \"w\");\n";
+    out += "if (!f) return;\n";
+    out += "fprintf(f, \"charta-profile 1 %d\\n\", " + n + ");\n";
+    out += "for (size_t i = 0; i < " + n + "; ++i)\n";
+    out += "fprintf(f, \"%lu %s\\n\", __iprof[i], __iprof_names[i]);\n";
+    out += "fclose(f);\n";
+    out += "}\n";
+    return out;
+}
+
+// One function's definition
+std::string function(traverser::Function const &fn, Context &ctx) {
+    std::string out{};
+    out += signature(fn, ctx) + " {\n";
+    if (ctx.opts.instrument) {
+        out += "++__iprof[" +
+               std::to_string(ctx.counter("fn " + symbols::name(fn.name))) +
+               "];\n";
+    }
+    out += "ch_stack_node *__istack = ch_stk_args(__ifull, " +
+           std::to_string(fn.args.args.size()) + ", " +
+           std::to_string(fn.args.kind == parser::Argument::Ellipses) +
+           ");\n";
+    emit_instrs(fn, out, ctx, Site{});
+    out += "}\n";
+    return out;
+}
+
+std::string prototypes(backend::c::Program const &prog, Context const &ctx) {
+    std::string out{};
+    for (auto const &fn : prog) {
+        out += signature(fn, ctx) + ";\n";
+    }
+    return out;
+}
+
+// The export table of a library, or the main of a program
+std::string entry(backend::c::Program const &prog, Context const &ctx) {
+    std::string out{};
+    if (ctx.opts.library) {
+        out += "ch_builtin const ch_exports[] = {\n";
+        for (auto const &fn : prog) {
+            out += "{" + parser::quote_str(symbols::name(fn.name)) + ", " +
+                   symbols::mangled(fn.name) + "},\n";
+        }
+        out += "{NULL, NULL}};\n";
+        if (ctx.opts.instrument) {
+            out += "__attribute__((constructor)) static void "
+                   "__iprof_init(void) {\n";
+            out += "atexit(__iprof_dump);\n";
+            out += "}\n";
+        }
+        return out;
+    }
+    out += "\n\nint main(void) {\n";
+    if (ctx.opts.instrument) {
+        out += "atexit(__iprof_dump);\n";
+    }
+    out += "ch_stack_node *stk = ch_stk_new();\n";
+    out += "__smain(&stk);\n";
+    out += "}\n";
+    return out;
+}
+
+std::string backend::c::make_c(Program prog, Options const &opts) {
+    Context ctx{opts};
+    collect_inlinable(prog, ctx);
+
+    std::string body{};
+    for (auto const &fn : prog) {
+        body += function(fn, ctx);
+    }
+
     std::string full{};
     full += "#include \"core.h\"\n";
-    for (auto fn : prog) {
-        full += "ch_stack_node *" + mangle(fn.name) +
-                "(ch_stack_node **__ifull) {\n";
-        full += "ch_stack_node *__istack = ch_stk_args(__ifull, " +
-                std::to_string(fn.args.args.size()) + ", " +
-                std::to_string(fn.args.kind == parser::Argument::Ellipses) +
-                ");\n";
-        emit_instrs(fn, full);
-        full += "}\n";
-    }
-    full += "\n\nint main(void) {\n";
-    full += "ch_stack_node *stk = ch_stk_new();\n";
-    full += "__smain(&stk);\n";
-    full += "}\n";
+    if (opts.instrument) {
+        full += "#include <stdio.h>\n";
+        full += "#include <stdlib.h>\n";
+        full += "static unsigned long __iprof[" +
+                std::to_string(std::max<std::size_t>(ctx.counters.size(), 1)) +
+                "];\n";
+        full += profile_writer(ctx);
+    }
+    full += prototypes(prog, ctx);
+    full += body;
+    full += entry(prog, ctx);
+    return full;
+}
+
+std::string backend::c::make_prelude(Program const &sigs,
+                                     Options const &opts) {
+    Context ctx{opts};
+    return "#include \"core.h\"\n" + prototypes(sigs, ctx);
+}
+
+std::string backend::c::make_function(traverser::Function const &fn,
+                                      Options const &opts) {
+    Context ctx{opts};
+    return function(fn, ctx);
+}
+
+std::string backend::c::make_entry(Program const &sigs, Options const &opts) {
+    Context ctx{opts};
+    return entry(sigs, ctx);
+}
+
+std::string show_typesig(parser::TypeSig const &type) {
+    return type.is_stack ? "[" + type.name + "]" : type.name;
+}
+
+std::string backend::c::make_header(Program const &prog) {
+    std::string full{};
+    full += "#pragma once\n";
+    full += "#include \"core.h\"\n\n";
+    full += "// Exported functions by Charta name, terminated by a NULL name\n";
+    full += "extern ch_builtin const ch_exports[];\n\n";
+    for (auto const &fn : prog) {
+        std::vector<std::string> args{};
+        for (auto const &[name, type] : fn.args.args) {
+            args.emplace_back(name + " : " + show_typesig(type));
+        }
+        if (fn.args.kind == parser::Argument::Ellipses) {
+            args.emplace_back("...");
+        }
+        std::vector<std::string> rets{};
+        for (auto const &type : fn.rets.args) {
+            rets.emplace_back(show_typesig(type));
+        }
+        if (fn.rets.rest) {
+            rets.emplace_back("... " + show_typesig(*fn.rets.rest));
+        }
+        full += "// " + symbols::name(fn.name) + " (" + intercalate(args, " ") +
+                ") -> (" + intercalate(rets, " ") + ")\n";
+        full += "ch_stack_node *" + symbols::mangled(fn.name) +
+                "(ch_stack_node **full);\n";
+    }
     return full;
 }
@@ -2,10 +2,35 @@
 
 #include "ir.hpp"
 #include "parser.hpp"
+#include "profile.hpp"
 #include "traverser.hpp"
+#include <optional>
+#include <string>
 #include <vector>
 
 namespace backend::c {
 using Program = std::vector<traverser::Function>;
-std::string make_c(Program prog);
+
+struct Options {
+    // Emit call and branch counters written to this file at exit
+    std::optional<std::string> instrument{};
+    // Counts from an instrumented run that guide inlining and layout
+    profile::Profile const *profile{nullptr};
+    // Leave out main and export every function through ch_exports
+    bool library{false};
+};
+
+std::string make_c(Program prog, Options const &opts = {});
+
+// make_c's output a piece at a time, for programs too large to hold whole:
+// the prelude declares every function, each definition follows on its own
+// and the entry point comes last. Only the signatures of sigs are read.
+// Instrumenting and profiles need the whole program, so opts may not ask
+// for them here.
+std::string make_prelude(Program const &sigs, Options const &opts = {});
+std::string make_function(traverser::Function const &fn,
+                          Options const &opts = {});
+std::string make_entry(Program const &sigs, Options const &opts = {});
+// C declarations of everything a library build exports
+std::string make_header(Program const &prog);
 }; // namespace backend::c
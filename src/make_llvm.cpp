@@ -0,0 +1,437 @@
+#include "make_llvm.hpp"
+#include "builtins.hpp"
+#include "checks.hpp"
+#include "ir.hpp"
+#include "mangler.hpp"
+#include "parser.hpp"
+#include "symbols.hpp"
+#include "traverser.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <set>
+#include <string>
+
+extern "C" {
+#include "core.h"
+}
+
+// Mirrors the C layout: the payload union starts at offset 8
+static_assert(sizeof(ch_value) == 32);
+static_assert(offsetof(ch_value, value) == 8);
+
+static const std::string preamble{
+    "%ch_value = type { i32, [3 x i64] }\n"
+    "%ch_string = type { ptr, i64, i64 }\n"
+    "%ch_stack_node = type { %ch_value, ptr }\n"
+    "\n"
+    "declare ptr @ch_stk_args(ptr nocapture, i64, i8 signext)\n"
+    "declare void @ch_stk_push(ptr nocapture, ptr byval(%ch_value) align 8)\n"
+    "declare void @ch_stk_pop(ptr sret(%ch_value) align 8, ptr nocapture)\n"
+    "declare void @ch_stk_append(ptr nocapture, ptr)\n"
+    "declare void @ch_stk_delete(ptr nocapture)\n"
+    "declare void @ch_str_new(ptr sret(%ch_string) align 8, ptr nocapture)\n"
+    "declare signext i8 @ch_valas_bool(ptr byval(%ch_value) align 8)\n"
+    "declare void @free(ptr nocapture)\n"
+    "\n"};
+
+// Metadata shared by every function
+static const std::string metadata{
+    "!0 = !{}\n"
+    "!1 = !{!\"branch_weights\", i32 1, i32 2000}\n"};
+
+struct InlineOp {
+    std::string_view name;
+    checks::Type::Kind operand;
+    checks::Type::Kind result;
+    std::string_view instr;
+};
+
+// Open-coded forms of the inlinable builtins, by the name of the builtin
+// that implements them
+// clang-format off
+static constexpr InlineOp inline_ops[] = {
+    {"+",  checks::Type::Int,   checks::Type::Int,   "add i32"},
+    {"-",  checks::Type::Int,   checks::Type::Int,   "sub i32"},
+    {"*",  checks::Type::Int,   checks::Type::Int,   "mul i32"},
+    {"=",  checks::Type::Int,   checks::Type::Bool,  "icmp eq i32"},
+    {"!=", checks::Type::Int,   checks::Type::Bool,  "icmp ne i32"},
+    {"+",  checks::Type::Float, checks::Type::Float, "fadd float"},
+    {"-",  checks::Type::Float, checks::Type::Float, "fsub float"},
+    {"*",  checks::Type::Float, checks::Type::Float, "fmul float"},
+    {"/",  checks::Type::Float, checks::Type::Float, "fdiv float"},
+    {"=",  checks::Type::Float, checks::Type::Bool,  "fcmp oeq float"},
+    {"!=", checks::Type::Float, checks::Type::Bool,  "fcmp une float"},
+    {"<",  checks::Type::Float, checks::Type::Bool,  "fcmp olt float"},
+    {">",  checks::Type::Float, checks::Type::Bool,  "fcmp ogt float"},
+    {"<=", checks::Type::Float, checks::Type::Bool,  "fcmp ole float"},
+    {">=", checks::Type::Float, checks::Type::Bool,  "fcmp oge float"},
+};
+// clang-format on
+
+// The runtime orders ints by comparing them as floats
+static constexpr std::string_view int_as_float[] = {"<", ">", "<=", ">="};
+
+std::string llvm_type(checks::Type::Kind kind) {
+    switch (kind) {
+    case checks::Type::Int:
+        return "i32";
+    case checks::Type::Float:
+        return "float";
+    default:
+        return "i8";
+    }
+}
+
+int value_kind(checks::Type::Kind kind) {
+    switch (kind) {
+    case checks::Type::Int:
+        return CH_VALK_INT;
+    case checks::Type::Float:
+        return CH_VALK_FLOAT;
+    case checks::Type::Bool:
+        return CH_VALK_BOOL;
+    case checks::Type::Char:
+        return CH_VALK_CHAR;
+    case checks::Type::String:
+        return CH_VALK_STRING;
+    default:
+        return CH_VALK_STACK;
+    }
+}
+
+std::string llvm_float(float f) {
+    return std::format("0x{:016X}",
+                       std::bit_cast<std::uint64_t>(static_cast<double>(f)));
+}
+
+std::string llvm_bytes(std::string const &s) {
+    std::string out{"c\""};
+    for (unsigned char c : s) {
+        if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\') {
+            out += c;
+        } else {
+            out += std::format("\\{:02X}", static_cast<unsigned>(c));
+        }
+    }
+    return out + "\\00\"";
+}
+
+class FnEmitter {
+    traverser::Function const &fn;
+    std::vector<checks::Fact> const *facts;
+    std::string &out;
+    std::string &globals;
+    std::size_t &string_counter;
+    std::size_t temp_counter{0};
+    bool open{true};
+
+    std::string temp() { return "%t" + std::to_string(temp_counter++); }
+
+    void line(std::string const &s) { out += "  " + s + "\n"; }
+
+    void block(std::string const &name) {
+        out += name + ":\n";
+        open = true;
+    }
+
+    checks::Fact fact(std::size_t ip) const {
+        if (!facts || ip >= facts->size())
+            return {};
+        return (*facts)[ip];
+    }
+
+    // Whether the branch target runs straight into the function's exit,
+    // which makes it an unlikely early return
+    bool is_early_exit(ir::LabelId label) const {
+        auto at = fn.body.ip_of(label);
+        if (!at)
+            return false;
+        for (auto it = fn.body.begin() + *at; it != fn.body.end(); ++it) {
+            switch (it->kind) {
+            case ir::Instruction::Exit:
+                return true;
+            case ir::Instruction::JumpTrue:
+            case ir::Instruction::Goto:
+                return false;
+            default:
+                break;
+            }
+        }
+        return false;
+    }
+
+    void push_value(int kind, std::string const &type,
+                    std::string const &payload) {
+        auto p = temp();
+        line(std::format("store i32 {}, ptr %v, align 8", kind));
+        line(std::format(
+            "{} = getelementptr inbounds %ch_value, ptr %v, i32 0, i32 1", p));
+        line(std::format("store {} {}, ptr {}, align 8", type, payload, p));
+        line("call void @ch_stk_push(ptr nonnull %stk, ptr byval(%ch_value) "
+             "align 8 %v)");
+    }
+
+    // Loads the node stored at `from` and its payload as `type`.
+    // Returns {node, payload pointer, value}.
+    std::array<std::string, 3> load_node(std::string const &from,
+                                         std::string const &type) {
+        auto node = temp();
+        auto payload = temp();
+        auto val = temp();
+        line(std::format("{} = load ptr, ptr {}, align 8, !nonnull !0", node,
+                         from));
+        line(std::format("{} = getelementptr inbounds %ch_stack_node, ptr {}, "
+                         "i32 0, i32 0, i32 1",
+                         payload, node));
+        line(std::format("{} = load {}, ptr {}, align 8", val, type, payload));
+        return {node, payload, val};
+    }
+
+    std::string next_of(std::string const &node) {
+        auto next = temp();
+        line(std::format(
+            "{} = getelementptr inbounds %ch_stack_node, ptr {}, i32 0, i32 1",
+            next, node));
+        return next;
+    }
+
+    bool try_inline(symbols::Id id, checks::Fact const &f) {
+        auto builtin = builtins::find(id);
+        if (!builtin || !(builtin->flags & builtins::Inlinable))
+            return false;
+        if (!f.top || !f.below || *f.top != *f.below)
+            return false;
+        auto callee = builtin->runtime;
+        checks::Type::Kind operand = *f.top;
+        bool widen = operand == checks::Type::Int &&
+                     std::ranges::find(int_as_float, callee) !=
+                         std::end(int_as_float);
+        auto op = std::ranges::find_if(inline_ops, [&](auto const &op) {
+            return op.name == callee &&
+                   op.operand == (widen ? checks::Type::Float : operand);
+        });
+        if (op == std::end(inline_ops))
+            return false;
+
+        // Overwrites the second node with the result and frees the top one
+        auto [top, top_payload, b] = load_node("%stk", llvm_type(operand));
+        auto [below, below_payload, a] =
+            load_node(next_of(top), llvm_type(operand));
+        if (widen) {
+            auto fa = temp();
+            auto fb = temp();
+            line(std::format("{} = sitofp i32 {} to float", fa, a));
+            line(std::format("{} = sitofp i32 {} to float", fb, b));
+            a = fa;
+            b = fb;
+        }
+        auto r = temp();
+        line(std::format("{} = {} {}, {}", r, op->instr, a, b));
+        if (op->result == checks::Type::Bool) {
+            auto byte = temp();
+            line(std::format("{} = zext i1 {} to i8", byte, r));
+            r = byte;
+        }
+        if (op->result != operand) {
+            line(std::format("store i32 {}, ptr {}, align 8",
+                             value_kind(op->result), below));
+        }
+        line(std::format("store {} {}, ptr {}, align 8",
+                         llvm_type(op->result), r, below_payload));
+        line(std::format("store ptr {}, ptr %stk, align 8", below));
+        line(std::format("call void @free(ptr {})", top));
+        return true;
+    }
+
+    std::string pop_bool(checks::Fact const &f) {
+        std::string b{};
+        if (f.top == checks::Type::Bool) {
+            auto [top, payload, val] = load_node("%stk", "i8");
+            auto link = next_of(top);
+            auto next = temp();
+            line(std::format("{} = load ptr, ptr {}, align 8", next, link));
+            line(std::format("store ptr {}, ptr %stk, align 8", next));
+            line(std::format("call void @free(ptr {})", top));
+            b = val;
+        } else {
+            b = temp();
+            line("call void @ch_stk_pop(ptr sret(%ch_value) align 8 %v, ptr "
+                 "nonnull %stk)");
+            line(std::format("{} = call signext i8 @ch_valas_bool(ptr "
+                             "byval(%ch_value) align 8 %v)",
+                             b));
+        }
+        auto cond = temp();
+        line(std::format("{} = icmp ne i8 {}, 0", cond, b));
+        return cond;
+    }
+
+    void emit_instr(std::size_t ip) {
+        auto const &ir = fn.body[ip];
+        if (!open && ir.kind != ir::Instruction::Label) {
+            block("d." + std::to_string(temp_counter++));
+        }
+        switch (ir.kind) {
+        case ir::Instruction::PushInt:
+            push_value(CH_VALK_INT, "i32",
+                       std::to_string(ir.int_value()));
+            break;
+        case ir::Instruction::PushFloat:
+            push_value(CH_VALK_FLOAT, "float",
+                       llvm_float(ir.float_value()));
+            break;
+        case ir::Instruction::PushChar:
+            push_value(CH_VALK_CHAR, "i32",
+                       std::to_string(ir.char_value()));
+            break;
+        case ir::Instruction::PushStr: {
+            auto const &s = fn.body.string(ir);
+            auto global = "@.str." + std::to_string(string_counter++);
+            globals += std::format(
+                "{} = private unnamed_addr constant [{} x i8] {}\n", global,
+                s.size() + 1, llvm_bytes(s));
+            auto p = temp();
+            line(std::format("store i32 {}, ptr %v, align 8",
+                             static_cast<int>(CH_VALK_STRING)));
+            line(std::format(
+                "{} = getelementptr inbounds %ch_value, ptr %v, i32 0, i32 1",
+                p));
+            line(std::format("call void @ch_str_new(ptr sret(%ch_string) "
+                             "align 8 {}, ptr {})",
+                             p, global));
+            line("call void @ch_stk_push(ptr nonnull %stk, ptr "
+                 "byval(%ch_value) align 8 %v)");
+            break;
+        }
+        case ir::Instruction::Call: {
+            auto callee = ir.callee();
+            if (try_inline(callee, fact(ip)))
+                break;
+            auto t = temp();
+            line(std::format("{} = call ptr @{}(ptr nonnull %stk)", t,
+                             symbols::mangled(builtins::target(callee))));
+            line(std::format(
+                "call void @ch_stk_append(ptr nonnull %stk, ptr {})", t));
+            break;
+        }
+        case ir::Instruction::JumpTrue: {
+            auto label = fn.body.label_name(ir.label());
+            auto cond = pop_bool(fact(ip));
+            auto fall = "c." + std::to_string(temp_counter++);
+            line(std::format("br i1 {}, label %{}, label %{}{}", cond, label,
+                             fall,
+                             is_early_exit(ir.label()) ? ", !prof !1" : ""));
+            block(fall);
+            break;
+        }
+        case ir::Instruction::Goto:
+            line("br label %" + fn.body.label_name(ir.label()));
+            open = false;
+            break;
+        case ir::Instruction::Label: {
+            auto label = fn.body.label_name(ir.label());
+            if (open) {
+                line("br label %" + label);
+            }
+            block(label);
+            break;
+        }
+        case ir::Instruction::Exit: {
+            auto t = temp();
+            line(std::format("{} = call ptr @ch_stk_args(ptr nonnull %stk, "
+                             "i64 {}, i8 signext {})",
+                             t, fn.rets.args.size(),
+                             static_cast<int>(fn.rets.rest.has_value())));
+            line("call void @ch_stk_delete(ptr nonnull %stk)");
+            line("ret ptr " + t);
+            open = false;
+            break;
+        }
+        case ir::Instruction::GotoPos:
+        case ir::Instruction::LabelPos:
+            assert(false && "Unreachable instruction");
+            break;
+        }
+    }
+
+  public:
+    FnEmitter(traverser::Function const &fn,
+              std::vector<checks::Fact> const *facts, std::string &out,
+              std::string &globals, std::size_t &string_counter)
+        : fn(fn), facts(facts), out(out), globals(globals),
+          string_counter(string_counter) {}
+
+    void emit() {
+        out += std::format("define ptr @{}(ptr noalias nocapture nonnull "
+                           "%full) nounwind {{\n",
+                           symbols::mangled(fn.name));
+        block("entry");
+        line("%stk = alloca ptr, align 8");
+        line("%v = alloca %ch_value, align 8");
+        line(std::format(
+            "%args = call ptr @ch_stk_args(ptr nonnull %full, i64 {}, i8 "
+            "signext {})",
+            fn.args.args.size(),
+            static_cast<int>(fn.args.kind == parser::Argument::Ellipses)));
+        line("store ptr %args, ptr %stk, align 8");
+        for (std::size_t ip = 0; ip < fn.body.size(); ++ip) {
+            emit_instr(ip);
+        }
+        if (open) {
+            line("unreachable");
+        }
+        out += "}\n\n";
+    }
+};
+
+std::string backend::llvm::make_llvm(Program prog,
+                                     checks::Facts const &facts) {
+    std::string code{};
+    std::string globals{};
+    std::size_t string_counter{0};
+
+    symbols::Table<traverser::Function const *> defined{};
+    for (auto const &fn : prog) {
+        defined[fn.name] = &fn;
+    }
+    // Mangled names of the runtime functions that are called
+    std::set<std::string> runtime{};
+    for (auto const &fn : prog) {
+        for (auto const &ir : fn.body) {
+            if (ir.kind != ir::Instruction::Call)
+                continue;
+            auto callee = ir.callee();
+            if (auto d = defined.find(callee); !d || !*d) {
+                runtime.emplace(symbols::mangled(builtins::target(callee)));
+            }
+        }
+    }
+
+    for (auto const &fn : prog) {
+        FnEmitter(fn, facts.find(fn.name), code, globals, string_counter)
+            .emit();
+    }
+
+    std::string full{preamble};
+    for (auto const &b : runtime) {
+        full += std::format("declare ptr @{}(ptr noalias nocapture nonnull)\n",
+                            b);
+    }
+    full += "\n" + globals + "\n" + code;
+    full += "define i32 @main() {\n"
+            "entry:\n"
+            "  %stk = alloca ptr, align 8\n"
+            "  store ptr null, ptr %stk, align 8\n"
+            "  %r = call ptr @" +
+            mangle("main") +
+            "(ptr nonnull %stk)\n"
+            "  ret i32 0\n"
+            "}\n\n";
+    full += metadata;
+    return full;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "checks.hpp"
+#include "traverser.hpp"
+#include <string>
+#include <vector>
+
+namespace backend::llvm {
+using Program = std::vector<traverser::Function>;
+std::string make_llvm(Program prog, checks::Facts const &facts);
+}; // namespace backend::llvm
@@ -1,10 +1,22 @@
+#include "builtins.hpp"
 #include "mangler.hpp"
 #include <print>
 #include <string>
 
+// Prints the mangled form of a name. With --builtins it prints the entries
+// of the runtime's table of builtins instead, one per builtin in
+// builtins.hpp, so the runtime can't drift from what the compiler expects.
 int main(int argc, char *argv[]) {
     if (argc < 2) {
         return 1;
     }
-    std::println("{}", mangle(std::string{argv[1]}));
+    std::string arg{argv[1]};
+    if (arg == "--builtins") {
+        for (auto const &builtin : builtins::table) {
+            std::string name{builtin.name};
+            std::println("    {{\"{}\", {}}},", name, mangle(name));
+        }
+        return 0;
+    }
+    std::println("{}", mangle(arg));
 }
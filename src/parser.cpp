@@ -1,6 +1,12 @@
 #include "parser.hpp"
+#include "pool.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <charconv>
 #include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <stdexcept>
 #include <string_view>
 #include <system_error>
@@ -17,7 +23,67 @@ char32_t parser::Lexer::peek() {
     }
 }
 
-char32_t parser::Lexer::pop() {
+// What a token starting with a given byte can be. Bytes that are not ASCII
+// only need decoding when they may start one of the arrow glyphs.
+enum class Lead : std::uint8_t {
+    Symbol,
+    Space,   // ' ', '\t', '\n'
+    Digit,   // A number
+    Sign,    // A number, "->" or a symbol
+    Special, // One of ?[](){}
+    Pair,    // "<-", "|^", "|v", "^|", "v|" or a symbol
+    Arrow,   // First byte of ←↑→↓, or a symbol
+    Char,
+    String,
+};
+
+static constexpr std::array<Lead, 256> leads = [] {
+    std::array<Lead, 256> t{};
+    t[' '] = t['\t'] = t['\n'] = Lead::Space;
+    for (char c = '0'; c <= '9'; ++c)
+        t[c] = Lead::Digit;
+    t['+'] = t['-'] = Lead::Sign;
+    for (char c : std::string_view{"?[](){}"})
+        t[c] = Lead::Special;
+    for (char c : std::string_view{"<|^v"})
+        t[c] = Lead::Pair;
+    t[0xE2] = Lead::Arrow;
+    t['\''] = Lead::Char;
+    t['"'] = Lead::String;
+    return t;
+}();
+
+// ASCII bytes a symbol never extends over
+static constexpr std::array<bool, 128> ends_symbol = [] {
+    std::array<bool, 128> t{};
+    for (char c : std::string_view{"?[](){}\"'\t\n\v\f\r "})
+        t[c] = true;
+    t[0] = true;
+    return t;
+}();
+
+static constexpr bool is_digit(char c) { return '0' <= c && c <= '9'; }
+
+// Whether one of "->", "<-", "|^", "|v", "^|" or "v|" starts at pos
+static bool ascii_arrow_at(std::string_view const s, std::size_t pos) {
+    if (pos + 1 >= s.size())
+        return false;
+    switch (s[pos]) {
+    case '-':
+        return s[pos + 1] == '>';
+    case '<':
+        return s[pos + 1] == '-';
+    case '|':
+        return s[pos + 1] == '^' || s[pos + 1] == 'v';
+    case '^':
+    case 'v':
+        return s[pos + 1] == '|';
+    default:
+        return false;
+    }
+}
+
+char32_t pop_utf(std::string_view const input, std::size_t &cursor) {
     std::size_t b;
     if (char32_t c = decode_utf(input, cursor, b); b) {
         cursor += b;
@@ -27,6 +93,8 @@ char32_t parser::Lexer::pop() {
     }
 }
 
+char32_t parser::Lexer::pop() { return pop_utf(input, cursor); }
+
 bool parser::Lexer::match(std::string_view const pat) {
     if (cursor + pat.size() - 1 < input.size() &&
         input.substr(cursor, pat.size()) == pat) {
@@ -39,27 +107,28 @@ bool parser::Lexer::match(std::string_view const pat) {
 
 bool parser::Lexer::parse_int_or_float() {
     std::size_t start = cursor;
-    if (char32_t c = peek(); c == U'+' || c == U'-') {
-        pop();
-    }
-    for (char32_t c = peek(); U'0' <= c && c <= U'9'; c = peek()) {
-        pop();
+    auto digits = [this] {
+        while (cursor < input.size() && is_digit(input[cursor]))
+            ++cursor;
+    };
+    if (cursor < input.size() &&
+        (input[cursor] == '+' || input[cursor] == '-')) {
+        ++cursor;
     }
+    digits();
     if (std::string_view s{input.data() + start, cursor - start};
         s.empty() || s == "+" || s == "-") {
         cursor = start;
         return false;
     }
-    if (peek() == U'.') {
-        pop();
-        for (char32_t c = peek(); U'0' <= c && c <= U'9'; c = peek()) {
-            pop();
-        }
+    if (cursor < input.size() && input[cursor] == '.') {
+        ++cursor;
+        digits();
 
         float val;
         if (std::from_chars(input.data() + start, input.data() + cursor, val)
                 .ec == std::errc()) {
-            output.emplace_back(
+            output.push(
                 Token{start, cursor, cursor - start, Token::Float, val});
         } else {
             throw ParserError(start, cursor,
@@ -69,7 +138,7 @@ bool parser::Lexer::parse_int_or_float() {
         int val;
         if (std::from_chars(input.data() + start, input.data() + cursor, val)
                 .ec == std::errc()) {
-            output.emplace_back(
+            output.push(
                 Token{start, cursor, cursor - start, Token::Int, val});
         } else {
             throw ParserError(start, cursor, "Integer conversion out of range");
@@ -80,23 +149,38 @@ bool parser::Lexer::parse_int_or_float() {
 
 bool parser::Lexer::parse_symbol() {
     auto start = cursor;
-    while (char32_t c = peek()) {
-        if (c == U'?' || c == U'[' || c == U']' || c == U'(' || c == U')' ||
-            c == U'{' || c == U'}' || c == U'"' || c == U'\'' || c == U'→' ||
-            c == U'←' || c == U'↑' || c == U'↓')
-            break;
-        if (is_space(c))
-            break;
-        if (match("->") || match("<-") || match("|^") || match("|v") ||
-            match("^|") || match("v|"))
+    std::size_t length{0};
+    while (cursor < input.size()) {
+        unsigned char b = input[cursor];
+        if (b < 0x80) {
+            if (ends_symbol[b])
+                break;
+            // A two-byte arrow ends the symbol, but is still part of it
+            if (ascii_arrow_at(input, cursor)) {
+                cursor += 2;
+                length += 2;
+                break;
+            }
+            ++cursor;
+            ++length;
+            continue;
+        }
+        std::size_t bytes;
+        char32_t c = decode_utf(input, cursor, bytes);
+        if (!bytes || c == U'→' || c == U'←' || c == U'↑' || c == U'↓' ||
+            is_space(c))
             break;
-        pop();
+        cursor += bytes;
+        ++length;
     }
     if (cursor == start)
         return false;
     auto sym = input.substr(start, cursor - start);
-    output.emplace_back(
-        Token{start, cursor, utf_length(sym), Token::Symbol, sym});
+    auto [it, added] = seen.try_emplace(sym);
+    if (added) {
+        it->second = symbols::intern(sym);
+    }
+    output.push(Token{start, cursor, length, Token::Symbol, it->second});
     return true;
 }
 
@@ -105,89 +189,89 @@ bool parser::Lexer::parse_special() {
     switch (peek()) {
     case U'?':
         pop();
-        output.emplace_back(
+        output.push(
             Token{start, cursor, cursor - start, Token::QMark, {}});
         return true;
     case U'[':
         pop();
-        output.emplace_back(
+        output.push(
             Token{start, cursor, cursor - start, Token::LSquare, {}});
         return true;
     case U']':
         pop();
-        output.emplace_back(
+        output.push(
             Token{start, cursor, cursor - start, Token::RSquare, {}});
         return true;
     case U'(':
         pop();
-        output.emplace_back(
+        output.push(
             Token{start, cursor, cursor - start, Token::LParen, {}});
         return true;
     case U')':
         pop();
-        output.emplace_back(
+        output.push(
             Token{start, cursor, cursor - start, Token::RParen, {}});
         return true;
     case U'{':
         pop();
-        output.emplace_back(
+        output.push(
             Token{start, cursor, cursor - start, Token::LCurly, {}});
         return true;
     case U'}':
         pop();
-        output.emplace_back(
+        output.push(
             Token{start, cursor, cursor - start, Token::RCurly, {}});
         return true;
     case U'←':
         pop();
-        output.emplace_back(Token{start, cursor, 1, Token::Left, {}});
+        output.push(Token{start, cursor, 1, Token::Left, {}});
         return true;
     case U'↑':
         pop();
-        output.emplace_back(Token{start, cursor, 1, Token::Up, {}});
+        output.push(Token{start, cursor, 1, Token::Up, {}});
         return true;
     case U'→':
         pop();
-        output.emplace_back(Token{start, cursor, 1, Token::Right, {}});
+        output.push(Token{start, cursor, 1, Token::Right, {}});
         return true;
     case U'↓':
         pop();
-        output.emplace_back(Token{start, cursor, 1, Token::Down, {}});
+        output.push(Token{start, cursor, 1, Token::Down, {}});
         return true;
     default:
         if (match("->")) {
-            output.emplace_back(
+            output.push(
                 Token{start, cursor, cursor - start, Token::Right, {}});
             return true;
         }
 
         if (match("<-")) {
-            output.emplace_back(
+            output.push(
                 Token{start, cursor, cursor - start, Token::Left, {}});
             return true;
         }
 
         if (match("|^")) {
-            output.emplace_back(Token{start, cursor, 1, Token::Up, {}});
-            output.emplace_back(Token{start + 1, cursor, 1, Token::Space, {}});
+            output.push(Token{start, cursor, 1, Token::Up, {}});
+            output.push(Token{start + 1, cursor, 1, Token::Space, {}});
             return true;
         }
 
         if (match("^|")) {
-            output.emplace_back(Token{start, start + 1, 1, Token::Space, {}});
-            output.emplace_back(Token{start + 1, cursor, 1, Token::Up, {}});
+            output.push(Token{start, start + 1, 1, Token::Space, {}});
+            output.push(Token{start + 1, cursor, 1, Token::Up, {}});
             return true;
         }
 
         if (match("|v")) {
-            output.emplace_back(Token{start, cursor, 1, Token::Down, {}});
-            output.emplace_back(Token{start + 1, cursor, 1, Token::Space, {}});
+            output.push(Token{start, cursor, 1, Token::Down, {}});
+            output.push(Token{start + 1, cursor, 1, Token::Space, {}});
             return true;
         }
 
         if (match("v|")) {
-            output.emplace_back(Token{start, start + 1, 1, Token::Space, {}});
-            output.emplace_back(Token{start + 1, cursor, 1, Token::Down, {}});
+            output.push(Token{start, start + 1, 1, Token::Space, {}});
+            output.push(Token{start + 1, cursor, 1, Token::Down, {}});
             return true;
         }
 
@@ -195,14 +279,15 @@ bool parser::Lexer::parse_special() {
     }
 }
 
-std::optional<char32_t> parser::Lexer::take_char() {
-    char32_t c = pop();
+std::optional<char32_t> take_escaped(std::string_view const input,
+                                     std::size_t &cursor) {
+    char32_t c = pop_utf(input, cursor);
     if (!c)
         return {};
     if (c == '\n')
         return {};
     if (c == U'\\') {
-        c = pop();
+        c = pop_utf(input, cursor);
         if (!c)
             return {};
         switch (c) {
@@ -220,6 +305,10 @@ std::optional<char32_t> parser::Lexer::take_char() {
     }
 }
 
+std::optional<char32_t> parser::Lexer::take_char() {
+    return take_escaped(input, cursor);
+}
+
 std::string escaped(char32_t c) {
     switch (c) {
     case U'\n':
@@ -234,20 +323,31 @@ std::string escaped(char32_t c) {
 }
 
 std::string parser::quote_str(std::string const &s) {
+    if (utf_invalid_at(s) != std::string_view::npos)
+        throw std::runtime_error("UTF failed");
+    // Only the control characters are escaped, everything else is copied
     std::string q{};
+    q.reserve(s.size() + 2);
     q += "\"";
-    for (std::size_t i = 0; i < s.size();) {
-        std::size_t b;
-        char32_t c = decode_utf(s, i, b);
-        if (b == 0)
-            throw std::runtime_error("UTF failed");
-        q += escaped(c);
-        i += b;
+    for (char c : s) {
+        if (c == '\n' || c == '\r' || c == '\t') {
+            q += escaped(c);
+        } else {
+            q += c;
+        }
     }
     q += "\"";
     return q;
 }
 
+std::string parser::unquote_str(std::string_view quoted) {
+    std::string s{};
+    for (std::size_t i = 1; i + 1 < quoted.size();) {
+        s += encode_utf8(*take_escaped(quoted, i));
+    }
+    return s;
+}
+
 std::string parser::quote_chr(char32_t c) {
     return "'" + (c == '\'' ? "\\'" : escaped(c)) + "'";
 }
@@ -263,7 +363,7 @@ bool parser::Lexer::parse_char() {
         return true;
     }
     pop();
-    output.emplace_back(Token{start, cursor,
+    output.push(Token{start, cursor,
                               utf_length(input.substr(start, cursor - start)),
                               Token::Char, *c});
     return true;
@@ -271,23 +371,25 @@ bool parser::Lexer::parse_char() {
 
 bool parser::Lexer::parse_string() {
     auto start = cursor;
-    if (peek() != U'"')
+    if (cursor >= input.size() || input[cursor] != '"')
         return false;
-    pop();
-    std::string contents{};
-    while (auto c = peek()) {
-        if (c == U'"') {
-            pop();
-            output.emplace_back(Token{
+    ++cursor;
+    // The input is valid UTF-8, so bytes of multi-byte characters are never
+    // mistaken for the ASCII ones looked for here
+    while (cursor < input.size() && input[cursor] != '\0') {
+        char c = input[cursor++];
+        if (c == '"') {
+            output.push(Token{
                 start, cursor, utf_length(input.substr(start, cursor - start)),
-                Token::String, contents});
+                Token::String, {}});
             return true;
         }
-        auto ch = take_char();
-        if (!ch) {
+        if (c == '\n')
             break;
+        if (c == '\\') {
+            if (cursor == input.size() || input[cursor++] == '\0')
+                break;
         }
-        contents += encode_utf8(*ch);
     }
     throw ParserError(start, cursor, "Unclosed string literal");
     return true;
@@ -295,29 +397,57 @@ bool parser::Lexer::parse_string() {
 
 bool parser::Lexer::parse_space() {
     auto start = cursor;
-    switch (peek()) {
-    case U' ':
-        pop();
-        output.emplace_back(Token{start, cursor, 1, Token::Space, {}});
+    switch (cursor < input.size() ? input[cursor] : 0) {
+    case ' ':
+        ++cursor;
+        output.push(Token{start, cursor, 1, Token::Space, {}});
         return true;
-    case U'\t':
-        pop();
-        output.emplace_back(Token{start, cursor, 4, Token::Space, {}});
+    case '\t':
+        ++cursor;
+        output.push(Token{start, cursor, 4, Token::Space, {}});
         return true;
-    case U'\n':
-        pop();
-        output.emplace_back(Token{start, cursor, 0, Token::Linebreak, {}});
+    case '\n':
+        ++cursor;
+        output.push(Token{start, cursor, 0, Token::Linebreak, {}});
         return true;
     }
     return false;
 }
 
 bool parser::Lexer::parse_one() {
-    return parse_space() || parse_int_or_float() || parse_special() ||
-           parse_char() || parse_string() || parse_symbol();
+    switch (leads[static_cast<unsigned char>(input[cursor])]) {
+    case Lead::Space:
+        return parse_space();
+    case Lead::Digit:
+        return parse_int_or_float();
+    case Lead::Sign:
+        return parse_int_or_float() || parse_special() || parse_symbol();
+    case Lead::Special:
+        return parse_special();
+    case Lead::Pair:
+    case Lead::Arrow:
+        return parse_special() || parse_symbol();
+    case Lead::Char:
+        return parse_char();
+    case Lead::String:
+        return parse_string();
+    case Lead::Symbol:
+        return parse_symbol();
+    }
+    return false;
 }
 
-std::vector<parser::Token> parser::Lexer::parse_all() {
+parser::Tokens parser::Lexer::parse_all() {
+    if (auto bad = utf_invalid_at(input); bad != std::string_view::npos) {
+        throw ParserError(bad, bad + 1, "Invalid UTF-8");
+    }
+    // Offsets are stored in 32 bits
+    if (input.size() > UINT32_MAX) {
+        throw ParserError(0, 0, "Source larger than 4 GiB");
+    }
+    // No token is shorter than a byte, so this never reallocates. Pages past
+    // the last token are never touched.
+    output.reserve(input.size());
     while (peek()) {
         if (!parse_one()) {
             auto start = cursor;
@@ -325,7 +455,90 @@ std::vector<parser::Token> parser::Lexer::parse_all() {
             throw ParserError(start, cursor - start, "Unknown character");
         }
     }
-    return output;
+    return std::move(output);
+}
+
+void parser::Tokens::reserve(std::size_t n) {
+    kinds.reserve(n);
+    starts.reserve(n);
+    ends.reserve(n);
+    lengths.reserve(n);
+    payloads.reserve(n);
+}
+
+void parser::Tokens::push(Token const &token) {
+    kinds.push_back(token.kind);
+    starts.push_back(token.start);
+    ends.push_back(token.end);
+    lengths.push_back(token.length);
+    payloads.push_back(std::visit(
+        [](auto v) { return std::bit_cast<std::uint32_t>(v); }, token.value));
+}
+
+void parser::Tokens::shift(std::size_t offset) {
+    for (auto &start : starts)
+        start += offset;
+    for (auto &end : ends)
+        end += offset;
+}
+
+parser::Token parser::Tokens::operator[](std::size_t i) const {
+    Token t{starts[i], ends[i], lengths[i], kinds[i], {}};
+    switch (kinds[i]) {
+    case Token::Int:
+        t.value = std::bit_cast<int>(payloads[i]);
+        break;
+    case Token::Float:
+        t.value = std::bit_cast<float>(payloads[i]);
+        break;
+    case Token::Char:
+        t.value = std::bit_cast<char32_t>(payloads[i]);
+        break;
+    case Token::Symbol:
+        t.value = std::bit_cast<symbols::Id>(payloads[i]);
+        break;
+    default:
+        break;
+    }
+    return t;
+}
+
+void parser::Grid::push(Node::Kind kind, std::size_t length,
+                        std::uint32_t payload) {
+    kinds.push_back(kind);
+    lengths.push_back(length);
+    payloads.push_back(payload);
+}
+
+void parser::Grid::push_string(std::size_t length, std::string str) {
+    push(Node::StrLit, length, strings.size());
+    strings.emplace_back(std::move(str));
+}
+
+void parser::Grid::end_row() { row_starts.push_back(kinds.size()); }
+
+parser::Node parser::Grid::operator[](std::size_t i) const {
+    Node n{kinds[i], lengths[i], {}};
+    switch (kinds[i]) {
+    case Node::IntLit:
+        n.value = std::bit_cast<int>(payloads[i]);
+        break;
+    case Node::FloatLit:
+        n.value = std::bit_cast<float>(payloads[i]);
+        break;
+    case Node::CharLit:
+        n.value = std::bit_cast<char32_t>(payloads[i]);
+        break;
+    case Node::StrLit:
+        n.value = std::string_view{strings[payloads[i]]};
+        break;
+    case Node::Call:
+        n.value = std::bit_cast<symbols::Id>(payloads[i]);
+        break;
+    default:
+        break;
+    }
+    return n;
 }
 
 std::optional<parser::Token> parser::Parser::peek() {
@@ -336,73 +549,78 @@ std::optional<parser::Token> parser::Parser::peek() {
     }
 }
 
-std::optional<parser::Node> parser::Parser::parse_node() {
-    if (auto t = peek(); t) {
-        switch (t->kind) {
-        case Token::Int:
-            ++cursor;
-            return Node{Node::IntLit, t->length, t->value};
-        case Token::Float:
-            ++cursor;
-            return Node{Node::FloatLit, t->length, t->value};
-        case Token::Char:
-            ++cursor;
-            return Node{Node::CharLit, t->length, t->value};
-        case Token::String:
-            ++cursor;
-            return Node{Node::StrLit, t->length, t->value};
-        case Token::Symbol:
-            ++cursor;
-            return Node{Node::Call, t->length, t->value};
-        case Token::QMark:
-            ++cursor;
-            return Node{Node::Branch, t->length, {}};
-        case Token::Left:
-            ++cursor;
-            return Node{Node::DirLeft, t->length, {}};
-        case Token::Right:
-            ++cursor;
-            return Node{Node::DirRight, t->length, {}};
-        case Token::Up:
-            ++cursor;
-            return Node{Node::DirUp, t->length, {}};
-        case Token::Down:
-            ++cursor;
-            return Node{Node::DirDown, t->length, {}};
-        case Token::Space:
-            ++cursor;
-            return Node{Node::Space, t->length, {}};
-        default:
-            return {};
-        }
-    }
+std::string_view parser::Parser::text(Token const &t) const {
+    return source.substr(t.start, t.end - t.start);
+}
 
-    return {};
+bool parser::Parser::parse_node(Grid &grid) {
+    if (cursor >= input.size()) {
+        return false;
+    }
+    auto length = input.length(cursor);
+    // Literal and symbol payloads carry over bit for bit
+    auto payload = input.payload(cursor);
+    switch (input.kind(cursor)) {
+    case Token::Int:
+        grid.push(Node::IntLit, length, payload);
+        break;
+    case Token::Float:
+        grid.push(Node::FloatLit, length, payload);
+        break;
+    case Token::Char:
+        grid.push(Node::CharLit, length, payload);
+        break;
+    case Token::String:
+        grid.push_string(length, unquote_str(text(input[cursor])));
+        break;
+    case Token::Symbol:
+        grid.push(Node::Call, length, payload);
+        break;
+    case Token::QMark:
+        grid.push(Node::Branch, length);
+        break;
+    case Token::Left:
+        grid.push(Node::DirLeft, length);
+        break;
+    case Token::Right:
+        grid.push(Node::DirRight, length);
+        break;
+    case Token::Up:
+        grid.push(Node::DirUp, length);
+        break;
+    case Token::Down:
+        grid.push(Node::DirDown, length);
+        break;
+    case Token::Space:
+        grid.push(Node::Space, length);
+        break;
+    default:
+        return false;
+    }
+    ++cursor;
+    return true;
 }
 
 parser::Grid parser::Parser::parse_grid() {
     Grid g{};
-    std::vector<Node> row{};
-    while (auto p = peek()) {
-        if (p->kind == Token::Linebreak) {
+    while (cursor < input.size()) {
+        if (input.kind(cursor) == Token::Linebreak) {
             ++cursor;
-            g.emplace_back(row);
-            row.clear();
-        } else if (auto n = parse_node()) {
-            row.emplace_back(*n);
-        } else {
+            g.end_row();
+        } else if (!parse_node(g)) {
             break;
         }
     }
-    if (!row.empty()) {
-        g.emplace_back(row);
+    if (g.row_open()) {
+        g.end_row();
     }
     return g;
 }
 
 void parser::Parser::spaces() {
-    while (auto p = peek()) {
-        if (p->kind != Token::Space && p->kind != Token::Linebreak)
+    while (cursor < input.size()) {
+        auto kind = input.kind(cursor);
+        if (kind != Token::Space && kind != Token::Linebreak)
             break;
         ++cursor;
     }
@@ -417,7 +635,7 @@ std::optional<parser::TypeSig> parser::Parser::parse_typesig() {
     }
     std::string name{};
     if (auto p = peek(); p && p->kind == Token::Symbol) {
-        name = std::get<std::string>(p->value);
+        name = text(*p);
     } else {
         throw ParserError(p->start, p->end, "Expected typename");
     }
@@ -434,14 +652,14 @@ std::optional<parser::TypeSig> parser::Parser::parse_typesig() {
 
 std::optional<parser::FnDecl> parser::Parser::parse_fndecl() {
     if (auto p = peek(); !(p && p->kind == Token::Symbol &&
-                           std::get<std::string>(p->value) == "fn")) {
+                           text(*p) == "fn")) {
         return {};
     }
     ++cursor;
     spaces();
-    std::string name;
+    symbols::Id name;
     if (auto p = peek(); p && p->kind == Token::Symbol) {
-        name = std::get<std::string>(p->value);
+        name = std::get<symbols::Id>(p->value);
     } else {
         throw ParserError(p->start, p->end, "Expected function name");
     }
@@ -466,7 +684,7 @@ std::optional<parser::FnDecl> parser::Parser::parse_fndecl() {
             is_closed = true;
             break;
         } else if (p->kind == Token::Symbol && !is_ellipses) {
-            std::string name = std::get<std::string>(p->value);
+            std::string name{text(*p)};
             if (name == "...") {
                 is_ellipses = true;
                 spaces();
@@ -474,7 +692,7 @@ std::optional<parser::FnDecl> parser::Parser::parse_fndecl() {
             }
             spaces();
             if (auto p = peek(); !(p && p->kind == Token::Symbol &&
-                                   std::get<std::string>(p->value) == ":")) {
+                                   text(*p) == ":")) {
                 throw ParserError(p->start, p->end, "Expected ':'");
             }
             ++cursor;
@@ -513,7 +731,7 @@ std::optional<parser::FnDecl> parser::Parser::parse_fndecl() {
             break;
         }
         if (p->kind == Token::Symbol &&
-            std::get<std::string>(p->value) == "...") {
+            text(*p) == "...") {
             ++cursor;
             spaces();
             auto typ = parse_typesig();
@@ -553,7 +771,8 @@ std::optional<parser::TopLevel> parser::Parser::parse_top_level() {
     return parse_fndecl();
 }
 
-std::vector<parser::TopLevel> parser::Parser::parse_program() {
+std::vector<parser::TopLevel>
+parser::Parser::parse_program(std::vector<Span> *spans) {
     std::vector<parser::TopLevel> tls{};
     while (auto p = peek()) {
         std::size_t start = cursor;
@@ -562,9 +781,156 @@ std::vector<parser::TopLevel> parser::Parser::parse_program() {
             continue;
         if (auto tl = parse_top_level()) {
             tls.emplace_back(*tl);
+            if (spans) {
+                spans->emplace_back(Span{p->start, input[cursor - 1].end});
+            }
         } else {
             throw ParserError(p->start, p->end, "Invalid top-level statement");
         }
     }
     return tls;
 }
+
+// Below this a source is not worth splitting
+static constexpr std::size_t min_chunk = 64 * 1024;
+
+// Where a top-level declaration starts at or after pos: an "fn" at the start
+// of a line, right after the closing '}' of the previous one. Literals never
+// span lines, so every line start is also a token boundary.
+static std::size_t next_boundary(std::string_view source, std::size_t pos) {
+    while ((pos = source.find("\nfn", pos)) != std::string_view::npos) {
+        auto at = pos + 1;
+        pos = at;
+        if (at + 2 < source.size() && source[at + 2] != ' ' &&
+            source[at + 2] != '\t') {
+            continue;
+        }
+        auto last = source.find_last_not_of(" \t\n", at - 1);
+        if (last != std::string_view::npos && source[last] == '}') {
+            return at;
+        }
+    }
+    return source.size();
+}
+
+std::vector<parser::TopLevel> parser::parse_source(std::string_view source) {
+    auto &workers = pool::shared();
+    if (workers.size() == 1 || source.size() < 2 * min_chunk) {
+        return Parser(Lexer(source).parse_all(), source).parse_program();
+    }
+    // Errors anywhere in the file are reported before anything is lexed
+    if (auto bad = utf_invalid_at(source); bad != std::string_view::npos) {
+        throw ParserError(bad, bad + 1, "Invalid UTF-8");
+    }
+    if (source.size() > UINT32_MAX) {
+        throw ParserError(0, 0, "Source larger than 4 GiB");
+    }
+
+    auto target = std::max(min_chunk, source.size() / (4 * workers.size()));
+    std::vector<std::size_t> bounds{0};
+    while (bounds.back() < source.size()) {
+        bounds.push_back(next_boundary(source, bounds.back() + target));
+    }
+
+    struct Chunk {
+        std::vector<TopLevel> decls{};
+        bool parsed{false};
+    };
+    std::vector<Chunk> chunks(bounds.size() - 1);
+    // Lexing is the same whatever the split, so the first lexer error is the
+    // one a single pass would stop at. A parse error may come from a split
+    // that was not really a declaration boundary, so it is settled by
+    // parsing the whole file again.
+    workers.for_each(chunks.size(), [&](std::size_t i) {
+        auto offset = bounds[i];
+        auto piece = source.substr(offset, bounds[i + 1] - offset);
+        Tokens tokens{};
+        try {
+            tokens = Lexer(piece).parse_all();
+        } catch (ParserError e) {
+            throw ParserError(e.start + offset, e.end + offset, e.what);
+        }
+        tokens.shift(offset);
+        try {
+            chunks[i].decls = Parser(std::move(tokens), source).parse_program();
+            chunks[i].parsed = true;
+        } catch (ParserError) {
+        }
+    });
+
+    if (!std::all_of(chunks.begin(), chunks.end(),
+                     [](auto &c) { return c.parsed; })) {
+        return Parser(Lexer(source).parse_all(), source).parse_program();
+    }
+    std::vector<TopLevel> decls{};
+    for (auto &chunk : chunks) {
+        std::move(chunk.decls.begin(), chunk.decls.end(),
+                  std::back_inserter(decls));
+    }
+    return decls;
+}
+
+std::vector<parser::FnSig> parser::outline_source(std::string_view source) {
+    return outline_source(source, Span{0, source.size()});
+}
+
+std::vector<parser::FnSig> parser::outline_source(std::string_view source,
+                                                  Span range) {
+    auto text = source.substr(range.start, range.end - range.start);
+    if (auto bad = utf_invalid_at(text); bad != std::string_view::npos) {
+        throw ParserError(range.start + bad, range.start + bad + 1,
+                          "Invalid UTF-8");
+    }
+    if (source.size() > UINT32_MAX) {
+        throw ParserError(0, 0, "Source larger than 4 GiB");
+    }
+    std::vector<FnSig> sigs{};
+    // Lexes and parses [offset, end), keeping only the signatures
+    auto outline = [&](std::size_t offset, std::size_t end) {
+        Tokens tokens{};
+        try {
+            tokens = Lexer(source.substr(offset, end - offset)).parse_all();
+        } catch (ParserError e) {
+            throw ParserError(e.start + offset, e.end + offset, e.what);
+        }
+        tokens.shift(offset);
+        std::vector<Span> spans{};
+        auto decls = Parser(std::move(tokens), source).parse_program(&spans);
+        for (std::size_t i = 0; i < decls.size(); ++i) {
+            auto &fn = std::get<FnDecl>(decls[i]);
+            sigs.emplace_back(FnSig{fn.name, std::move(fn.args),
+                                    std::move(fn.rets), spans[i]});
+        }
+    };
+    for (std::size_t offset = range.start; offset < range.end;) {
+        auto end = std::min(next_boundary(source, offset + min_chunk),
+                            range.end);
+        // Everything before offset parsed as whole declarations, so a single
+        // pass would be here too. A piece that does not parse may end at a
+        // split that was not really a boundary, so it is tried again up to
+        // a boundary at least twice as far, until it parses or reaches the
+        // end and throws the error a single pass would. Doubling keeps a
+        // real error from reparsing the rest of the range over and over.
+        for (;;) {
+            try {
+                outline(offset, end);
+                break;
+            } catch (ParserError) {
+                if (end == range.end) {
+                    throw;
+                }
+                end = std::min(next_boundary(source, 2 * end - offset),
+                               range.end);
+            }
+        }
+        offset = end;
+    }
+    return sigs;
+}
+
+parser::FnDecl parser::parse_at(std::string_view source, Span span) {
+    auto tokens =
+        Lexer(source.substr(span.start, span.end - span.start)).parse_all();
+    tokens.shift(span.start);
+    return *Parser(std::move(tokens), source).parse_fndecl();
+}
@@ -1,9 +1,13 @@
 #pragma once
 
+#include "symbols.hpp"
 #include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -19,7 +23,7 @@ struct ParserError : std::exception {
 struct Token {
     std::size_t start, end; // In file
     std::size_t length;     // For grid
-    enum Kind {
+    enum Kind : std::uint8_t {
         Int,
         Float,
         Char,
@@ -39,13 +43,41 @@ struct Token {
         Linebreak,
         Space
     } kind;
-    std::variant<int, float, char32_t, std::string> value;
+    // Strings are read back from [start, end) of the source
+    std::variant<int, float, char32_t, symbols::Id> value;
+};
+
+// Tokens stored as parallel arrays. A Token is assembled on access, so
+// looking at one never allocates.
+class Tokens {
+    std::vector<Token::Kind> kinds{};
+    std::vector<std::uint32_t> starts{};
+    std::vector<std::uint32_t> ends{};
+    std::vector<std::uint32_t> lengths{};
+    // Bits of the int, float, char or symbol id, depending on the kind
+    std::vector<std::uint32_t> payloads{};
+
+  public:
+    void reserve(std::size_t n);
+    void push(Token const &token);
+
+    // Moves every offset forward, for tokens lexed from part of a source
+    void shift(std::size_t offset);
+
+    std::size_t size() const { return kinds.size(); }
+    Token::Kind kind(std::size_t i) const { return kinds[i]; }
+    std::size_t length(std::size_t i) const { return lengths[i]; }
+    std::uint32_t payload(std::size_t i) const { return payloads[i]; }
+    Token operator[](std::size_t i) const;
 };
 
 class Lexer {
-    std::string input;
+    std::string_view input;
     std::size_t cursor{0};
-    std::vector<Token> output{};
+    Tokens output{};
+    // Symbols already interned by this lexer, so repeated names do not
+    // touch the shared interner
+    std::unordered_map<std::string_view, symbols::Id> seen{};
 
     char32_t peek();
 
@@ -56,7 +88,7 @@ class Lexer {
     bool match(std::string_view const pat);
 
   public:
-    Lexer(std::string input) : input(std::move(input)) {}
+    Lexer(std::string_view input) : input(input) {}
 
     bool parse_int_or_float();
     bool parse_char();
@@ -66,11 +98,11 @@ class Lexer {
     bool parse_space();
 
     bool parse_one();
-    std::vector<Token> parse_all();
+    Tokens parse_all();
 };
 
 struct Node {
-    enum Kind {
+    enum Kind : std::uint8_t {
         IntLit,
         FloatLit,
         CharLit,
@@ -84,10 +116,35 @@ struct Node {
         Space
     } kind;
     std::size_t length;
-    std::variant<int, float, char32_t, std::string> value;
+    std::variant<int, float, char32_t, std::string_view, symbols::Id> value;
 };
 
-using Grid = std::vector<std::vector<Node>>;
+// Cells of a function body stored row after row in one set of parallel
+// arrays, with string literals kept to the side. A Node is a view of one
+// cell and is only valid as long as the grid.
+class Grid {
+    std::vector<Node::Kind> kinds{};
+    std::vector<std::uint32_t> lengths{};
+    // Bits of the literal, the symbol id, or the index into strings
+    std::vector<std::uint32_t> payloads{};
+    std::vector<std::string> strings{};
+    // Cells of row y are [row_starts[y], row_starts[y + 1])
+    std::vector<std::uint32_t> row_starts{0};
+
+  public:
+    void push(Node::Kind kind, std::size_t length, std::uint32_t payload = 0);
+    void push_string(std::size_t length, std::string str);
+    void end_row();
+    bool row_open() const { return kinds.size() != row_starts.back(); }
+
+    std::size_t rows() const { return row_starts.size() - 1; }
+    std::size_t row_begin(std::size_t y) const { return row_starts[y]; }
+    std::size_t row_end(std::size_t y) const { return row_starts[y + 1]; }
+    std::size_t cells() const { return kinds.size(); }
+    Node::Kind kind(std::size_t i) const { return kinds[i]; }
+    std::size_t length(std::size_t i) const { return lengths[i]; }
+    Node operator[](std::size_t i) const;
+};
 
 struct TypeSig {
     std::string name;
@@ -105,7 +162,7 @@ struct Return {
 };
 
 struct FnDecl {
-    std::string name;
+    symbols::Id name;
     Argument args;
     Return rets;
     Grid body;
@@ -113,18 +170,37 @@ struct FnDecl {
 
 using TopLevel = std::variant<FnDecl>;
 
+// Where a top-level declaration sits in the source, from the start of its
+// first token to the end of its last
+struct Span {
+    std::size_t start, end;
+};
+
+// A function declaration without its body, which can be parsed again from
+// span when it is needed
+struct FnSig {
+    symbols::Id name;
+    Argument args;
+    Return rets;
+    Span span;
+};
+
 class Parser {
-    std::vector<Token> input;
+    Tokens input;
+    std::string_view source;
     std::size_t cursor{0};
 
     std::optional<Token> peek();
 
+    std::string_view text(Token const &t) const;
+
     void spaces();
 
   public:
-    Parser(std::vector<Token> input) : input(std::move(input)) {}
+    Parser(Tokens input, std::string_view source)
+        : input(std::move(input)), source(source) {}
 
-    std::optional<Node> parse_node();
+    bool parse_node(Grid &grid);
 
     Grid parse_grid();
 
@@ -134,9 +210,27 @@ class Parser {
 
     std::optional<TopLevel> parse_top_level();
 
-    std::vector<TopLevel> parse_program();
+    // Where each declaration was found goes to spans, if given
+    std::vector<TopLevel> parse_program(std::vector<Span> *spans = nullptr);
 };
 
+// Lexes and parses a whole program. Large sources are split at top-level
+// declarations and the pieces handled on the shared pool; the declarations,
+// token offsets and any error come out as if it had been done in one pass.
+std::vector<TopLevel> parse_source(std::string_view source);
+
+// Signatures of every declaration in a program. The source is read a piece
+// at a time and the bodies dropped as it goes, so only one piece's grids are
+// ever held. Errors are the ones parse_source reports.
+std::vector<FnSig> outline_source(std::string_view source);
+// The same for the declarations in range, which has to start and end
+// between them
+std::vector<FnSig> outline_source(std::string_view source, Span range);
+// The declaration outline_source found at span
+FnDecl parse_at(std::string_view source, Span span);
+
 std::string quote_str(std::string const &s);
+// Contents of a lexed string literal, quotes included, with escapes resolved
+std::string unquote_str(std::string_view quoted);
 std::string quote_chr(char32_t c);
 } // namespace parser
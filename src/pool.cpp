@@ -0,0 +1,85 @@
+#include "pool.hpp"
+#include <algorithm>
+
+pool::Pool::Pool(std::size_t threads) {
+    for (std::size_t i = 1; i < threads; ++i) {
+        workers.emplace_back([this] { loop(); });
+    }
+}
+
+pool::Pool::~Pool() {
+    {
+        std::scoped_lock guard{lock};
+        stopping = true;
+    }
+    wake.notify_all();
+    // jthread joins on destruction
+}
+
+void pool::Pool::work(Batch &batch) {
+    for (std::size_t i; (i = batch.next++) < batch.count;) {
+        try {
+            batch.fn(i);
+        } catch (...) {
+            batch.errors[i] = std::current_exception();
+        }
+        if (++batch.done == batch.count) {
+            std::scoped_lock guard{lock};
+            finished.notify_all();
+        }
+    }
+}
+
+void pool::Pool::loop() {
+    std::unique_lock guard{lock};
+    for (;;) {
+        wake.wait(guard, [this] {
+            return stopping || (current && current->next < current->count);
+        });
+        if (stopping) {
+            return;
+        }
+        auto &batch = *current;
+        ++batch.users;
+        guard.unlock();
+        work(batch);
+        guard.lock();
+        if (--batch.users == 0) {
+            finished.notify_all();
+        }
+    }
+}
+
+void pool::Pool::for_each(std::size_t count,
+                          std::function<void(std::size_t)> const &fn) {
+    if (count == 0) {
+        return;
+    }
+    std::scoped_lock one_batch{running};
+    Batch batch{fn, count};
+    if (count > 1 && !workers.empty()) {
+        {
+            std::scoped_lock guard{lock};
+            current = &batch;
+        }
+        wake.notify_all();
+    }
+    work(batch);
+    {
+        std::unique_lock guard{lock};
+        current = nullptr;
+        finished.wait(guard, [&] {
+            return batch.done == batch.count && batch.users == 0;
+        });
+    }
+    for (auto &error : batch.errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+pool::Pool &pool::shared() {
+    static Pool global{std::max(1u, std::thread::hardware_concurrency())};
+    return global;
+}
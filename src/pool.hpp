@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pool {
+// Fixed set of worker threads that split index ranges between them. The
+// calling thread works too, so a pool of one thread runs everything inline.
+class Pool {
+    struct Batch {
+        std::function<void(std::size_t)> const &fn;
+        std::size_t count;
+        std::atomic<std::size_t> next{0};
+        std::atomic<std::size_t> done{0};
+        // Workers still holding a pointer to the batch, guarded by lock
+        std::size_t users{0};
+        std::vector<std::exception_ptr> errors;
+
+        Batch(std::function<void(std::size_t)> const &fn, std::size_t count)
+            : fn(fn), count(count), errors(count) {}
+    };
+
+    std::vector<std::jthread> workers{};
+    std::mutex lock{};
+    std::condition_variable wake{};
+    std::condition_variable finished{};
+    Batch *current{nullptr};
+    bool stopping{false};
+    // Only one batch runs at a time
+    std::mutex running{};
+
+    void work(Batch &batch);
+    void loop();
+
+  public:
+    explicit Pool(std::size_t threads);
+    Pool(Pool const &) = delete;
+    Pool &operator=(Pool const &) = delete;
+    ~Pool();
+
+    std::size_t size() const { return workers.size() + 1; }
+
+    // Calls fn(i) for every i below count and returns once all are done. If
+    // any call throws, the exception of the lowest index is rethrown, so
+    // errors come out as if the calls had run in order. Must not be called
+    // from inside fn.
+    void for_each(std::size_t count,
+                  std::function<void(std::size_t)> const &fn);
+};
+
+// Sized to the machine
+Pool &shared();
+} // namespace pool
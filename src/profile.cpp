@@ -0,0 +1,63 @@
+#include "profile.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+std::uint64_t profile::Profile::calls_of(std::string const &fn) const {
+    auto it = calls.find(fn);
+    return it == calls.end() ? 0 : it->second;
+}
+
+std::optional<profile::Branch>
+profile::Profile::branch(std::string const &fn,
+                         std::string const &label) const {
+    auto f = branches.find(fn);
+    if (f == branches.end())
+        return {};
+    auto b = f->second.find(label);
+    if (b == f->second.end())
+        return {};
+    return b->second;
+}
+
+std::uint64_t profile::Profile::hottest() const {
+    std::uint64_t max{0};
+    for (auto &[fn, count] : calls) {
+        max = std::max(max, count);
+    }
+    return max;
+}
+
+std::optional<profile::Profile>
+profile::read_profile(std::filesystem::path const &path) {
+    std::ifstream file(path);
+    std::string magic;
+    int version;
+    std::size_t counters;
+    if (!(file >> magic >> version >> counters) || magic != "charta-profile" ||
+        version != 1) {
+        return {};
+    }
+    Profile prof{};
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        std::istringstream ss(line);
+        std::uint64_t count;
+        std::string kind, fn;
+        if (!(ss >> count >> kind >> fn))
+            return {};
+        if (kind == "fn") {
+            prof.calls[fn] += count;
+        } else if (kind == "br") {
+            std::string label, which;
+            if (!(ss >> label >> which))
+                return {};
+            auto &b = prof.branches[fn][label];
+            (which == "taken" ? b.taken : b.total) += count;
+        } else {
+            return {};
+        }
+    }
+    return prof;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace profile {
+// Counts written by an instrumented build, one line per counter:
+//   charta-profile 1 <counters>
+//   <count> fn <function>
+//   <count> br <function> <label> total
+//   <count> br <function> <label> taken
+struct Branch {
+    std::uint64_t taken{0};
+    std::uint64_t total{0};
+};
+
+struct Profile {
+    std::unordered_map<std::string, std::uint64_t> calls{};
+    std::unordered_map<std::string, std::unordered_map<std::string, Branch>>
+        branches{};
+
+    std::uint64_t calls_of(std::string const &fn) const;
+    std::optional<Branch> branch(std::string const &fn,
+                                 std::string const &label) const;
+    std::uint64_t hottest() const;
+};
+
+std::optional<Profile> read_profile(std::filesystem::path const &path);
+} // namespace profile
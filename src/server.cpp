@@ -0,0 +1,214 @@
+#include "server.hpp"
+#include "builder.hpp"
+#include "ircache.hpp"
+#include "source.hpp"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <optional>
+#include <print>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// What the server keeps between requests
+struct Warm {
+    std::filesystem::path root;
+    builder::Memo memo{};
+    // Built programs, named after what they were built from
+    std::filesystem::path outputs;
+    std::atomic<std::size_t> copies{0};
+};
+
+static std::string reply(builder::BuildError const &e) {
+    std::string what{e.what};
+    for (auto &c : what) {
+        if (c == '\n') {
+            c = ' ';
+        }
+    }
+    if (e.at) {
+        return std::format("err {} {} {}\n", e.at->start, e.at->end, what);
+    }
+    return std::format("err - - {}\n", what);
+}
+
+// Copies through a file in the same directory as to, so whoever reads to
+// sees either the old file or the whole new one
+static void copy_into_place(Warm &warm, std::filesystem::path const &from,
+                            std::filesystem::path const &to) {
+    auto partial = to;
+    partial += std::format(".{}.partial", warm.copies++);
+    std::filesystem::copy_file(
+        from, partial, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::rename(partial, to);
+}
+
+static std::string build(Warm &warm, std::vector<std::string> const &lines) {
+    if (lines.size() < 3 || lines[0] != server::greeting) {
+        throw builder::BuildError{"Malformed request"};
+    }
+    std::filesystem::path cwd{lines[1]};
+    auto file = cwd / lines[2];
+    source::Source input{};
+    try {
+        input = source::Source::map(file);
+    } catch (source::SourceError e) {
+        throw builder::BuildError{e.what};
+    }
+
+    bool shared{false};
+    bool profiled{false};
+    std::string backend{"c"};
+    auto key = ircache::key_of(input.view(), false);
+    builder::Builder b{std::move(input), file.string()};
+    for (std::size_t i = 3; i < lines.size(); ++i) {
+        auto const &arg = lines[i];
+        if (arg == "-llvm") {
+            b.llvm();
+            backend = "llvm";
+        } else if (arg == "-asm") {
+            b.assembly();
+            backend = "asm";
+        } else if (arg == "-pgo-gen") {
+            b.profile_generate();
+            profiled = true;
+        } else if (arg == "-pgo-use") {
+            b.profile_use();
+            profiled = true;
+        } else if (arg == "-cache") {
+            b.cached();
+        } else if (arg == "-stream") {
+            b.streamed();
+        } else if (arg == "-shared") {
+            b.shared();
+            shared = !shared;
+        } else {
+            // Everything else prints to or runs in the server
+            throw builder::BuildError{
+                std::format("'{}' is not available from a server", arg)};
+        }
+    }
+    b.remember(warm.memo);
+
+    auto stem = file.stem().string();
+    auto out_file = cwd / (shared ? "lib" + stem + ".so" : "out_" + stem);
+    auto header = std::filesystem::path{out_file}.replace_extension(".h");
+    // Profiles change between builds of the same text, so those are always
+    // built
+    std::optional<std::filesystem::path> kept{};
+    if (!profiled) {
+        kept = warm.outputs / std::format("{:016x}-{}-{}-{}", key.hash,
+                                          key.size, backend, shared);
+    }
+    auto kept_header = kept ? std::filesystem::path{*kept} += ".h"
+                            : std::filesystem::path{};
+    if (kept && std::filesystem::exists(*kept)) {
+        copy_into_place(warm, *kept, out_file);
+        if (shared) {
+            copy_into_place(warm, kept_header, header);
+        }
+        return std::format("ok {}\n", out_file.string());
+    }
+
+    b.build(warm.root, out_file.string());
+    if (kept) {
+        if (shared) {
+            copy_into_place(warm, header, kept_header);
+        }
+        copy_into_place(warm, out_file, *kept);
+    }
+    return std::format("ok {}\n", out_file.string());
+}
+
+// Reads up to the empty line that ends a request
+static std::optional<std::vector<std::string>> receive(int client) {
+    std::string in{};
+    char chunk[4096];
+    while (in.find("\n\n") == std::string::npos) {
+        auto got = read(client, chunk, sizeof(chunk));
+        if (got <= 0) {
+            return {};
+        }
+        in.append(chunk, got);
+    }
+    in.resize(in.find("\n\n"));
+    std::vector<std::string> lines{};
+    std::istringstream stream{in};
+    for (std::string line; std::getline(stream, line);) {
+        lines.emplace_back(std::move(line));
+    }
+    return lines;
+}
+
+static void answer(Warm &warm, int client) {
+    std::string out{};
+    try {
+        if (auto lines = receive(client)) {
+            out = build(warm, *lines);
+        }
+    } catch (builder::BuildError e) {
+        out = reply(e);
+    } catch (std::exception const &e) {
+        out = reply(builder::BuildError{e.what()});
+    } catch (...) {
+        out = reply(builder::BuildError{"Internal error"});
+    }
+    for (std::size_t sent = 0; sent < out.size();) {
+        auto wrote =
+            send(client, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (wrote <= 0) {
+            break;
+        }
+        sent += wrote;
+    }
+    close(client);
+}
+
+void server::serve(std::filesystem::path const &socket,
+                   std::filesystem::path const &root) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    auto path = socket.string();
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw ServerError{std::format("Socket path '{}' is too long", path)};
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        throw ServerError{std::format("Could not create a socket: {}",
+                                      std::strerror(errno))};
+    }
+    // Left behind by a server that did not shut down cleanly
+    std::error_code ignored{};
+    std::filesystem::remove(socket, ignored);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) < 0 ||
+        listen(listener, SOMAXCONN) < 0) {
+        throw ServerError{std::format("Could not listen on '{}': {}", path,
+                                      std::strerror(errno))};
+    }
+
+    // A compiler that exits early must fail its build, not the server
+    std::signal(SIGPIPE, SIG_IGN);
+    // Outputs of an earlier server may come from another runtime
+    static Warm warm{root, {}, path + ".outputs"};
+    std::filesystem::remove_all(warm.outputs);
+    std::filesystem::create_directories(warm.outputs);
+    std::println("Listening on {}", path);
+    std::fflush(stdout);
+    while (true) {
+        int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+        std::thread{answer, std::ref(warm), client}.detach();
+    }
+}
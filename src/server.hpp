@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <unistd.h>
+
+// A compiler that stays up between builds, taking requests over a Unix
+// socket. It keeps the traversed and checked programs and the outputs it
+// built, so building a file that did not change since the last request is a
+// copy. Every connection carries one request:
+//   charta 1
+//   <working directory of the client>
+//   <source file, then one flag per line>
+//   <empty line>
+// and gets one line back:
+//   ok <output file>
+//   err <start> <end> <message>
+// where start and end are the byte offsets the error is about, or - when it
+// is not about a place in the source. Paths are taken relative to the
+// client's working directory.
+namespace server {
+inline constexpr char const *greeting = "charta 1";
+
+struct ServerError {
+    std::string what;
+};
+
+// $CHARTA_SOCKET, or a socket in /tmp that belongs to this user
+inline std::filesystem::path socket_path() {
+    if (char const *path = std::getenv("CHARTA_SOCKET")) {
+        return path;
+    }
+    return std::format("/tmp/charta-{}.sock", getuid());
+}
+
+// Answers requests until the process is killed, with the runtime found in
+// root, building requests side by side
+[[noreturn]] void serve(std::filesystem::path const &socket,
+                        std::filesystem::path const &root);
+} // namespace server
@@ -0,0 +1,67 @@
+#include "source.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+source::Source source::Source::map(std::filesystem::path const &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw SourceError{std::format("Could not open '{}': {}", path.string(),
+                                      std::strerror(errno))};
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw SourceError{std::format("Could not stat '{}': {}", path.string(),
+                                      std::strerror(errno))};
+    }
+    Source src{};
+    // Empty files cannot be mapped, and have nothing to map anyway
+    if (st.st_size > 0) {
+        void *pages = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pages == MAP_FAILED) {
+            close(fd);
+            throw SourceError{std::format("Could not map '{}': {}",
+                                          path.string(), std::strerror(errno))};
+        }
+        madvise(pages, st.st_size, MADV_SEQUENTIAL);
+        src.mapping = pages;
+        src.length = st.st_size;
+    }
+    close(fd);
+    return src;
+}
+
+source::Source::Source(Source &&other)
+    : mapping(std::exchange(other.mapping, nullptr)),
+      length(std::exchange(other.length, 0)), owned(std::move(other.owned)) {}
+
+source::Source &source::Source::operator=(Source &&other) {
+    if (this != &other) {
+        if (mapping) {
+            munmap(mapping, length);
+        }
+        mapping = std::exchange(other.mapping, nullptr);
+        length = std::exchange(other.length, 0);
+        owned = std::move(other.owned);
+    }
+    return *this;
+}
+
+source::Source::~Source() {
+    if (mapping) {
+        munmap(mapping, length);
+    }
+}
+
+std::string_view source::Source::view() const {
+    if (mapping) {
+        return {static_cast<char const *>(mapping), length};
+    }
+    return owned;
+}
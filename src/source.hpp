@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace source {
+struct SourceError {
+    std::string what;
+};
+
+// Program text, either mapped read-only from a file or owned in memory.
+// Everything lexed from it refers back into view(), so it has to outlive
+// the tokens.
+class Source {
+    void *mapping{nullptr};
+    std::size_t length{0};
+    std::string owned{};
+
+  public:
+    Source() = default;
+    explicit Source(std::string text) : owned(std::move(text)) {}
+    Source(Source const &) = delete;
+    Source &operator=(Source const &) = delete;
+    Source(Source &&other);
+    Source &operator=(Source &&other);
+    ~Source();
+
+    static Source map(std::filesystem::path const &path);
+
+    std::string_view view() const;
+};
+} // namespace source
@@ -0,0 +1,54 @@
+#include "symbols.hpp"
+#include "builtins.hpp"
+#include "mangler.hpp"
+#include <mutex>
+
+symbols::Interner::Interner() {
+    for (auto const &builtin : builtins::table) {
+        intern(builtin.name);
+    }
+}
+
+symbols::Id symbols::Interner::intern(std::string_view name) {
+    {
+        std::shared_lock guard{lock};
+        if (auto it = ids.find(name); it != ids.end()) {
+            return it->second;
+        }
+    }
+    std::unique_lock guard{lock};
+    // Another thread may have added it in between
+    if (auto it = ids.find(name); it != ids.end()) {
+        return it->second;
+    }
+    Id id{static_cast<std::uint32_t>(names.size())};
+    auto const &stored = names.emplace_back(name);
+    ids.emplace(stored, id);
+    return id;
+}
+
+std::string const &symbols::Interner::name(Id id) const {
+    std::shared_lock guard{lock};
+    return names[index(id)];
+}
+
+std::size_t symbols::Interner::size() const {
+    std::shared_lock guard{lock};
+    return names.size();
+}
+
+std::string const &symbols::Interner::mangled(Id id) {
+    std::unique_lock guard{lock};
+    if (index(id) >= mangled_names.size()) {
+        mangled_names.resize(names.size());
+    }
+    if (mangled_names[index(id)].empty()) {
+        mangled_names[index(id)] = mangle(names[index(id)]);
+    }
+    return mangled_names[index(id)];
+}
+
+symbols::Interner &symbols::interner() {
+    static Interner global{};
+    return global;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Every distinct symbol is interned once, while lexing, and the rest of the
+// pipeline passes around its Id. Data derived from a symbol lives in tables
+// indexed by that Id instead of maps keyed by the name.
+namespace symbols {
+enum class Id : std::uint32_t {};
+
+inline std::size_t index(Id id) { return static_cast<std::size_t>(id); }
+
+// Safe to use from several threads. Which Id a name gets then depends on
+// scheduling, so nothing may rely on the numeric order of Ids, except that
+// the builtins are interned first, in the order of builtins::table.
+class Interner {
+    // Deque keeps the names in place, so the views in ids stay valid
+    std::deque<std::string> names{};
+    std::unordered_map<std::string_view, Id> ids{};
+    // Grows at the back only, so handed out references stay valid
+    std::deque<std::string> mangled_names{};
+    mutable std::shared_mutex lock{};
+
+  public:
+    Interner();
+
+    Id intern(std::string_view name);
+    std::string const &name(Id id) const;
+    std::string const &mangled(Id id);
+    std::size_t size() const;
+};
+
+Interner &interner();
+
+inline Id intern(std::string_view name) { return interner().intern(name); }
+inline std::string const &name(Id id) { return interner().name(id); }
+// The C symbol of a Charta function, computed on first use
+inline std::string const &mangled(Id id) { return interner().mangled(id); }
+
+// Per-symbol data, grown on demand up to the largest Id stored
+template <typename T> class Table {
+    std::vector<T> slots{};
+
+  public:
+    T &operator[](Id id) {
+        if (index(id) >= slots.size()) {
+            slots.resize(index(id) + 1);
+        }
+        return slots[index(id)];
+    }
+
+    T const *find(Id id) const {
+        return index(id) < slots.size() ? &slots[index(id)] : nullptr;
+    }
+};
+} // namespace symbols
@@ -1,10 +1,15 @@
 #include "traverser.hpp"
 #include "ir.hpp"
 #include "parser.hpp"
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
+#include <memory_resource>
+#include <optional>
 #include <print>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -21,25 +26,220 @@ struct Pos {
 
 struct PosHash {
     std::uint64_t operator()(Pos const &pos) const {
-        return std::hash<int>()(pos.x) ^ (std::hash<int>()(pos.y) << 1);
+        auto key = static_cast<std::uint64_t>(static_cast<std::uint32_t>(pos.x))
+                       << 32 |
+                   static_cast<std::uint32_t>(pos.y);
+        // Fibonacci hashing spreads neighbouring cells across buckets
+        return key * 0x9E3779B97F4A7C15ull;
     }
 };
 
-std::optional<parser::Node> grid_at(parser::Grid const &grid, Pos pos) {
-    // std::println("{}, {}", pos.x, pos.y);
-    if (pos.y < 0 || pos.y >= grid.size() || pos.x < 0) {
+// Maps a position to the cell covering it. Single-column spaces make up
+// most of a grid and are left out, and a position inside a row that no
+// other cell covers is a space. Rows are cut into blocks of a few columns,
+// and a hash table gives the first cell reaching into each block that has
+// any, from where a lookup walks at most the block's width of cells. A
+// traversal step resolves its position to an entry once, and hands that to
+// the lookups after it.
+class GridIndex {
+    static constexpr int block_bits = 3;
+    // Slots hold an entry, and this when they are free
+    static constexpr std::uint32_t empty = ~std::uint32_t{0};
+
+    parser::Grid const &grid;
+    // Indexed cells of row y are [row_firsts[y], row_firsts[y + 1])
+    std::pmr::vector<std::uint32_t> row_firsts;
+    std::pmr::vector<std::uint32_t> widths;
+    // Per indexed cell: its first column, its position in the grid, and
+    // where its columns start in a table over all indexed columns
+    std::pmr::vector<std::uint32_t> starts;
+    std::pmr::vector<std::uint32_t> cells;
+    std::pmr::vector<std::uint32_t> firsts;
+    std::uint32_t indexed{0};
+    // Open addressing with linear probing, at most half full, picked by the
+    // top bits of the block's hash. Cells are known by the blocks they are
+    // first in, so a slot needs no key.
+    std::pmr::vector<std::uint32_t> slots;
+    int shift{64};
+
+    static bool is_blank(parser::Grid const &grid, std::size_t i) {
+        return grid.kind(i) == parser::Node::Space && grid.length(i) == 1;
+    }
+
+    std::uint32_t end_of(std::uint32_t e) const {
+        return starts[e] + grid.length(cells[e]);
+    }
+
+    std::size_t slot_of(int block, int y) const {
+        return shift == 64 ? 0 : PosHash{}(Pos{block, y}) >> shift;
+    }
+
+    // Whether e is the first cell of row y reaching into block
+    bool first_in(std::uint32_t e, int block, int y) const {
+        std::uint32_t from = block << block_bits;
+        return row_firsts[y] <= e && e < row_firsts[y + 1] &&
+               starts[e] < from + (1u << block_bits) && end_of(e) > from &&
+               (e == row_firsts[y] || end_of(e - 1) <= from);
+    }
+
+  public:
+    using Entry = std::optional<std::uint32_t>;
+
+    GridIndex(parser::Grid const &grid, std::pmr::memory_resource *memory)
+        : grid(grid), row_firsts(1, 0, memory), widths(memory),
+          starts(memory), cells(memory), firsts(memory), slots(memory) {
+        row_firsts.reserve(grid.rows() + 1);
+        widths.reserve(grid.rows());
+        for (std::size_t y = 0; y < grid.rows(); ++y) {
+            std::uint32_t x{0};
+            for (auto i = grid.row_begin(y); i < grid.row_end(y); ++i) {
+                if (!is_blank(grid, i)) {
+                    starts.push_back(x);
+                    cells.push_back(i);
+                    firsts.push_back(indexed);
+                    indexed += grid.length(i);
+                }
+                x += grid.length(i);
+            }
+            row_firsts.push_back(starts.size());
+            widths.push_back(x);
+        }
+
+        // Calls f with each block and the first cell reaching into it
+        auto each_block = [&](auto f) {
+            for (std::size_t y = 0; y < grid.rows(); ++y) {
+                std::uint32_t next{0};
+                for (auto e = row_firsts[y]; e < row_firsts[y + 1]; ++e) {
+                    auto last = (end_of(e) - 1) >> block_bits;
+                    for (auto b = std::max(next, starts[e] >> block_bits);
+                         b <= last; ++b) {
+                        f(static_cast<int>(b), static_cast<int>(y), e);
+                    }
+                    next = last + 1;
+                }
+            }
+        };
+        std::size_t blocks{0};
+        each_block([&](int, int, std::uint32_t) { ++blocks; });
+        auto capacity = std::bit_ceil(std::max<std::size_t>(1, 2 * blocks));
+        shift = 64 - std::countr_zero(capacity);
+        slots.assign(capacity, empty);
+        each_block([&](int block, int y, std::uint32_t e) {
+            auto s = slot_of(block, y);
+            while (slots[s] != empty) {
+                s = (s + 1) & (capacity - 1);
+            }
+            slots[s] = e;
+        });
+    }
+
+    // Columns covered by indexed cells, over the whole grid
+    std::size_t columns() const { return indexed; }
+    std::size_t width(int y) const { return widths[y]; }
+
+    bool contains(Pos pos) const {
+        return 0 <= pos.y && pos.y < grid.rows() && 0 <= pos.x &&
+               pos.x < widths[pos.y];
+    }
+
+    // Entry of the indexed cell covering pos
+    Entry entry(Pos pos) const {
+        if (!contains(pos)) {
+            return {};
+        }
+        auto block = pos.x >> block_bits;
+        auto s = slot_of(block, pos.y);
+        while (!first_in(slots[s], block, pos.y)) {
+            if (slots[s] == empty) {
+                return {};
+            }
+            s = (s + 1) & (slots.size() - 1);
+        }
+        auto e = slots[s];
+        auto x = static_cast<std::uint32_t>(pos.x);
+        while (e + 1 < row_firsts[pos.y + 1] && starts[e + 1] <= x) {
+            ++e;
+        }
+        if (!covers(e, pos.x)) {
+            return {};
+        }
+        return e;
+    }
+
+    // Whether entry e covers column x of its row
+    bool covers(std::uint32_t e, int x) const {
+        return starts[e] <= static_cast<std::uint32_t>(x) &&
+               static_cast<std::uint32_t>(x) < end_of(e);
+    }
+
+    // Position of column x among the indexed columns, for the entry
+    // covering it
+    std::size_t column(std::uint32_t e, int x) const {
+        return firsts[e] + (x - starts[e]);
+    }
+
+    // The node at pos, whose entry is e
+    std::optional<parser::Node> at(Pos pos, Entry e) const {
+        if (e) {
+            return grid[cells[*e]];
+        }
+        if (contains(pos)) {
+            return parser::Node{parser::Node::Space, 1, {}};
+        }
         return {};
     }
-    auto const &row = grid[pos.y];
-    int x = 0;
-    for (auto const &node : row) {
-        if (x <= pos.x && pos.x < x + node.length) {
-            return node;
+
+    bool is(Pos pos, parser::Node::Kind kind) const {
+        auto e = entry(pos);
+        return e && grid.kind(cells[*e]) == kind;
+    }
+};
+
+// Positions a traversal has been through: a bit per indexed column, and the
+// spaces it crossed
+class Visited {
+    GridIndex const &index;
+    std::pmr::vector<bool> columns;
+    std::pmr::unordered_set<Pos, PosHash> spaces;
+
+  public:
+    Visited(GridIndex const &index, std::pmr::memory_resource *memory)
+        : index(index), columns(index.columns(), false, memory),
+          spaces(memory) {}
+
+    // Whether pos, whose entry is e, was visited
+    bool contains(Pos pos, GridIndex::Entry e) const {
+        if (e) {
+            return columns[index.column(*e, pos.x)];
         }
-        x += node.length;
+        return spaces.contains(pos);
     }
-    return {};
-}
+
+    // Marks length positions from pos, whose entry is e, stopping at the
+    // end of the row. Entering a cell from above or below starts part way
+    // in, so the span can run into the cells after it.
+    void mark(Pos pos, GridIndex::Entry e, std::size_t length) {
+        auto end = std::min<std::size_t>(pos.x + length, index.width(pos.y));
+        for (; static_cast<std::size_t>(pos.x) < end; ++pos.x) {
+            if (!e || !index.covers(*e, pos.x)) {
+                e = index.entry(pos);
+            }
+            if (e) {
+                columns[index.column(*e, pos.x)] = true;
+            } else {
+                spaces.insert(pos);
+            }
+        }
+    }
+};
+
+// Cell a positional jump or label refers to, and for labels the width of
+// the cell
+struct IrPos {
+    int x;
+    int y;
+    std::size_t length{0};
+};
 
 bool is_vert(Pos dir) { return dir.y != 0; }
 
@@ -48,153 +248,239 @@ static Pos right{1, 0};
 static Pos up{0, -1};
 static Pos down{0, 1};
 
-std::vector<Instruction> filter_pos(std::vector<Instruction> instrs) {
-    std::vector<Instruction> next_instrs{};
+// Replaces the positional jumps with labels, in body
+void filter_pos(std::pmr::vector<Instruction> const &instrs,
+                std::pmr::vector<IrPos> const &places, ir::Body &body,
+                std::pmr::memory_resource *memory) {
+    // Visited cells never overlap, so every column belongs to at most one
+    // LabelPos. Each GotoPos names its target label in goto order.
+    std::pmr::unordered_map<Pos, std::size_t, PosHash> label_at{memory};
+    // Memory given back to the arena is not reused, so the table is sized
+    // up front instead of growing through rehashes
+    std::size_t labelled{0};
+    for (auto const &instr : instrs) {
+        if (instr.kind == ir::Instruction::LabelPos) {
+            labelled += places[instr.operand].length;
+        }
+    }
+    label_at.reserve(labelled);
+    for (std::size_t i = 0; i < instrs.size(); ++i) {
+        if (instrs[i].kind == ir::Instruction::LabelPos) {
+            auto pos = places[instrs[i].operand];
+            for (std::size_t dx = 0; dx < pos.length; ++dx) {
+                label_at.emplace(Pos{pos.x + static_cast<int>(dx), pos.y}, i);
+            }
+        }
+    }
+    std::pmr::unordered_map<std::size_t, std::pmr::vector<IrPos>> targets{
+        memory};
     for (auto &instr : instrs) {
         if (instr.kind == ir::Instruction::GotoPos) {
-            auto pos = std::get<IrPos>(instr.value);
-            next_instrs.emplace_back(Instruction{
-                Instruction::Goto, std::format("P_{}_{}", pos.x, pos.y)});
+            auto gpos = places[instr.operand];
+            if (auto l = label_at.find(Pos{gpos.x, gpos.y});
+                l != label_at.end()) {
+                targets[l->second].emplace_back(gpos);
+            }
+        }
+    }
+
+    // Gotos from the same cell share their label
+    std::pmr::unordered_map<Pos, ir::LabelId, PosHash> path_labels{memory};
+    auto label_of = [&](IrPos gpos) {
+        auto [it, added] = path_labels.emplace(
+            Pos{gpos.x, gpos.y}, ir::LabelId(body.labels.size()));
+        if (added) {
+            body.labels.emplace_back(ir::LabelSite{false, gpos.x, gpos.y});
+        }
+        return it->second;
+    };
+
+    auto &code = body.code;
+    code.reserve(instrs.size());
+    for (std::size_t i = 0; i < instrs.size(); ++i) {
+        auto instr = instrs[i];
+        if (instr.kind == ir::Instruction::GotoPos) {
+            code.emplace_back(Instruction::to(Instruction::Goto,
+                                              label_of(places[instr.operand])));
         } else if (instr.kind == ir::Instruction::LabelPos) {
-            auto pos = std::get<IrPos>(instr.value);
-            for (auto &i : instrs) {
-                if (i.kind == ir::Instruction::GotoPos) {
-                    auto gpos = std::get<IrPos>(i.value);
-                    if (pos.x <= gpos.x && gpos.x < pos.x + pos.length &&
-                        gpos.y == pos.y) {
-                        next_instrs.emplace_back(Instruction{
-                            Instruction::Label,
-                            std::format("P_{}_{}", gpos.x, gpos.y)});
+            if (auto t = targets.find(i); t != targets.end()) {
+                for (auto &gpos : t->second) {
+                    auto label = label_of(gpos);
+                    body.label_ips.resize(body.labels.size(),
+                                          ir::Body::nowhere);
+                    if (body.label_ips[ir::index(label)] == ir::Body::nowhere) {
+                        body.label_ips[ir::index(label)] = code.size();
+                        code.emplace_back(
+                            Instruction::to(Instruction::Label, label));
                     }
                 }
             }
         } else {
-            next_instrs.emplace_back(instr);
+            if (instr.kind == ir::Instruction::Label) {
+                body.label_ips.resize(body.labels.size(), ir::Body::nowhere);
+                body.label_ips[ir::index(instr.label())] = code.size();
+            }
+            code.emplace_back(instr);
         }
     }
-    return next_instrs;
+    body.label_ips.resize(body.labels.size(), ir::Body::nowhere);
 }
 
-std::vector<std::pair<Pos, Pos>> get_perps(parser::Grid const &grid, Pos pos,
-                                           Pos dir) {
-    std::vector<std::pair<Pos, Pos>> poses{};
+std::pmr::vector<std::pair<Pos, Pos>>
+get_perps(GridIndex const &index, Pos pos, Pos dir,
+          std::pmr::memory_resource *memory) {
+    std::pmr::vector<std::pair<Pos, Pos>> poses{memory};
     if (is_vert(dir)) {
-        if (auto n = grid_at(grid, pos + left);
-            n && n->kind == parser::Node::DirLeft) {
+        if (index.is(pos + left, parser::Node::DirLeft)) {
             poses.emplace_back(std::pair{left, pos + left});
         }
-
-        if (auto n = grid_at(grid, pos + right);
-            n && n->kind == parser::Node::DirRight) {
+        if (index.is(pos + right, parser::Node::DirRight)) {
             poses.emplace_back(std::pair{right, pos + right});
         }
     } else {
-        if (auto n = grid_at(grid, pos + up);
-            n && n->kind == parser::Node::DirUp) {
+        if (index.is(pos + up, parser::Node::DirUp)) {
             poses.emplace_back(std::pair{up, pos + up});
         }
-
-        if (auto n = grid_at(grid, pos + down);
-            n && n->kind == parser::Node::DirDown) {
+        if (index.is(pos + down, parser::Node::DirDown)) {
             poses.emplace_back(std::pair{down, pos + down});
         }
     }
     return poses;
 }
 
-std::vector<Instruction> traverser::traverse(parser::Grid grid) {
-    std::vector<Instruction> instrs{};
-    std::unordered_set<Pos, PosHash> visited{};
-    auto run_emit = [&](Pos dir, Pos pos, auto &&self) -> void {
-        // std::println("{}, {}, {}, {}", pos.x, pos.y, dir.x, dir.y);
-        if (auto n = grid_at(grid, pos)) {
-            // std::println("{}, {}", static_cast<int>(n->kind), n->length);
+// A pending walk, or an instruction to emit once the walks pushed after it
+// have finished
+struct Step {
+    Pos dir;
+    Pos pos;
+    std::optional<Instruction> emit{};
+};
+
+ir::Body traverser::traverse(parser::Grid const &grid) {
+    // Everything but the result lives here and is released in one go
+    std::pmr::monotonic_buffer_resource scratch{};
+
+    ir::Body body{};
+    std::pmr::vector<Instruction> instrs{&scratch};
+    // Operands of GotoPos and LabelPos
+    std::pmr::vector<IrPos> places{&scratch};
+    GridIndex index{grid, &scratch};
+    // Most cells give a label and one instruction
+    instrs.reserve(2 * grid.cells());
+    Visited visited{index, &scratch};
+    std::pmr::vector<Step> work{{Step{right, {0, 0}}}, &scratch};
+
+    while (!work.empty()) {
+        auto step = std::move(work.back());
+        work.pop_back();
+        if (step.emit) {
+            instrs.emplace_back(std::move(*step.emit));
+            continue;
+        }
+        auto dir = step.dir;
+        auto pos = step.pos;
+        for (;;) {
+            auto e = index.entry(pos);
+            auto n = index.at(pos, e);
+            if (!n) {
+                if (is_vert(dir) && 0 <= pos.y && pos.y < grid.rows()) {
+                    pos = pos + dir;
+                    continue;
+                }
+                instrs.emplace_back(Instruction{Instruction::Exit, {}});
+                break;
+            }
             auto next_pos = is_vert(dir) ? pos + dir : dir * n->length + pos;
-            if (visited.contains(pos)) {
+            if (visited.contains(pos, e)) {
+                auto go = Instruction{
+                    Instruction::GotoPos,
+                    static_cast<std::uint32_t>(places.size())};
+                places.emplace_back(IrPos{pos.x, pos.y});
                 if (n->kind == parser::Node::Space) {
-                    self(dir, next_pos, self);
+                    // The goto comes after everything reached past the space
+                    work.emplace_back(Step{dir, pos, std::move(go)});
+                    work.emplace_back(Step{dir, next_pos});
+                } else {
+                    instrs.emplace_back(std::move(go));
                 }
-                instrs.emplace_back(
-                    Instruction{Instruction::GotoPos, IrPos{pos.x, pos.y}});
-                return;
+                break;
             }
-            instrs.emplace_back(Instruction{Instruction::LabelPos,
-                                            IrPos{pos.x, pos.y, n->length}});
+            instrs.emplace_back(
+                Instruction{Instruction::LabelPos,
+                            static_cast<std::uint32_t>(places.size())});
+            places.emplace_back(IrPos{pos.x, pos.y, n->length});
 
-            for (std::size_t i = 0; i < n->length; ++i) {
-                visited.emplace(pos + Pos{1, 0} * i);
-            }
+            visited.mark(pos, e, n->length);
             switch (n->kind) {
             case parser::Node::IntLit:
-                instrs.emplace_back(
-                    Instruction{Instruction::PushInt, std::get<int>(n->value)});
-                self(dir, next_pos, self);
-                break;
+                instrs.emplace_back(Instruction::push(std::get<int>(n->value)));
+                pos = next_pos;
+                continue;
             case parser::Node::FloatLit:
-                instrs.emplace_back(Instruction{Instruction::PushFloat,
-                                                std::get<float>(n->value)});
-                self(dir, next_pos, self);
-                break;
+                instrs.emplace_back(
+                    Instruction::push(std::get<float>(n->value)));
+                pos = next_pos;
+                continue;
             case parser::Node::CharLit:
-                instrs.emplace_back(Instruction{Instruction::PushChar,
-                                                std::get<char32_t>(n->value)});
-                self(dir, next_pos, self);
-                break;
+                instrs.emplace_back(
+                    Instruction::push(std::get<char32_t>(n->value)));
+                pos = next_pos;
+                continue;
             case parser::Node::StrLit:
                 instrs.emplace_back(Instruction{
-                    Instruction::PushStr, std::get<std::string>(n->value)});
-                self(dir, next_pos, self);
-                break;
+                    Instruction::PushStr,
+                    static_cast<std::uint32_t>(body.strings.size())});
+                body.strings.emplace_back(
+                    std::get<std::string_view>(n->value));
+                pos = next_pos;
+                continue;
             case parser::Node::Call:
-                instrs.emplace_back(Instruction{
-                    Instruction::Call, std::get<std::string>(n->value)});
-                self(dir, next_pos, self);
-                break;
+                instrs.emplace_back(
+                    Instruction::call(std::get<symbols::Id>(n->value)));
+                pos = next_pos;
+                continue;
             case parser::Node::Branch: {
-                auto perps = get_perps(grid, pos, dir);
-                if (perps.size() == 1) {
-                    auto lbl = std::format("B_{}_{}", pos.x, pos.y);
-                    instrs.emplace_back(
-                        Instruction{Instruction::JumpTrue, lbl});
-                    self(dir, next_pos, self);
-                    instrs.emplace_back(Instruction{Instruction::Label, lbl});
-                    self(perps.front().first, perps.front().second, self);
-                } else {
+                auto perps = get_perps(index, pos, dir, &scratch);
+                if (perps.size() != 1) {
                     throw TraverserError(pos.x, pos.y,
                                          "Branch expected 1 direction, got " +
                                              std::to_string(perps.size()));
                 }
-                break;
+                ir::LabelId lbl{static_cast<std::uint32_t>(body.labels.size())};
+                body.labels.emplace_back(ir::LabelSite{true, pos.x, pos.y});
+                instrs.emplace_back(
+                    Instruction::to(Instruction::JumpTrue, lbl));
+                // Fall through first, then the label and the taken branch
+                work.emplace_back(
+                    Step{perps.front().first, perps.front().second});
+                work.emplace_back(
+                    Step{dir, pos, Instruction::to(Instruction::Label, lbl)});
+                pos = next_pos;
+                continue;
             }
             case parser::Node::DirLeft:
-                self(left, pos + (is_vert(dir) ? left : left * n->length),
-                     self);
-                break;
+                pos = pos + (is_vert(dir) ? left : left * n->length);
+                dir = left;
+                continue;
             case parser::Node::DirUp:
-                self(up, pos + (is_vert(dir) ? up : up * n->length), self);
-                break;
+                pos = pos + (is_vert(dir) ? up : up * n->length);
+                dir = up;
+                continue;
             case parser::Node::DirRight:
-                self(right, pos + (is_vert(dir) ? right : right * n->length),
-                     self);
-                break;
+                pos = pos + (is_vert(dir) ? right : right * n->length);
+                dir = right;
+                continue;
             case parser::Node::DirDown:
-                self(down, pos + (is_vert(dir) ? down : down * n->length),
-                     self);
-                break;
+                pos = pos + (is_vert(dir) ? down : down * n->length);
+                dir = down;
+                continue;
             case parser::Node::Space:
-                self(dir, next_pos, self);
-                break;
+                pos = next_pos;
+                continue;
             }
-        } else if (is_vert(dir) && 0 <= pos.y && pos.y < grid.size()) {
-            self(dir, pos + dir, self);
-        } else {
-            instrs.emplace_back(Instruction{Instruction::Exit, {}});
+            break;
         }
-    };
-
-    run_emit({1, 0}, {0, 0}, run_emit);
-    // for (auto &instr : instrs) {
-    //     std::println("{}", instr.show());
-    // }
-    return filter_pos(std::move(instrs));
+    }
+    filter_pos(instrs, places, body, &scratch);
+    return body;
 }
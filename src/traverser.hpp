@@ -5,10 +5,10 @@
 
 namespace traverser {
 struct Function {
-    std::string name;
+    symbols::Id name;
     parser::Argument args;
     parser::Return rets;
-    std::vector<ir::Instruction> body;
+    ir::Body body;
 };
 struct TraverserError : std::exception {
     int x;
@@ -18,5 +18,5 @@ struct TraverserError : std::exception {
     TraverserError(int x, int y, std::string what)
         : std::exception(), x(x), y(y), what(std::move(what)) {}
 };
-std::vector<ir::Instruction> traverse(parser::Grid grid);
+ir::Body traverse(parser::Grid const &grid);
 } // namespace traverser
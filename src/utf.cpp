@@ -1,8 +1,12 @@
 #include "utf.hpp"
-#include <stdexcept>
+#include <bit>
 #include <string>
 #include <string_view>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 bool is_space(char32_t c) {
     switch (c) {
     case U'\u0009':
@@ -28,31 +32,54 @@ bool is_space(char32_t c) {
     }
 }
 
-char32_t decode_utf(std::string_view const str, std::size_t pos,
-                    std::size_t &bytes) {
-    bytes = 0;
+// Length of the well-formed sequence starting at pos, or 0
+std::size_t sequence_length(std::string_view const str, std::size_t pos) {
+    auto at = [&](std::size_t i) -> unsigned char {
+        return pos + i < str.size() ? str[pos + i] : 0;
+    };
+    auto cont = [&](std::size_t i, unsigned char lo = 0x80,
+                    unsigned char hi = 0xBF) {
+        return lo <= at(i) && at(i) <= hi;
+    };
     if (pos >= str.size())
         return 0;
-    unsigned char c = str[pos];
+    unsigned char c = at(0);
+    if (c < 0x80)
+        return 1;
+    if (0xC2 <= c && c <= 0xDF)
+        return cont(1) ? 2 : 0;
+    if (0xE0 <= c && c <= 0xEF) {
+        bool second = c == 0xE0   ? cont(1, 0xA0)
+                      : c == 0xED ? cont(1, 0x80, 0x9F)
+                                  : cont(1);
+        return second && cont(2) ? 3 : 0;
+    }
+    if (0xF0 <= c && c <= 0xF4) {
+        bool second = c == 0xF0   ? cont(1, 0x90)
+                      : c == 0xF4 ? cont(1, 0x80, 0x8F)
+                                  : cont(1);
+        return second && cont(2) && cont(3) ? 4 : 0;
+    }
+    return 0;
+}
 
-    if (c < 0x80) {
-        bytes = 1;
-        return c;
-    } else if ((c >> 5) == 0b110 && pos + 1 < str.size()) {
-        bytes = 2;
-        return ((c & 31) << 6) | (str[pos + 1] & 63);
-    } else if ((c >> 4) == 0b1110 && pos + 2 < str.size()) {
-        bytes = 3;
-        return ((c & 15) << 12) | ((str[pos + 1] & 63) << 6) |
+char32_t decode_utf(std::string_view const str, std::size_t pos,
+                    std::size_t &bytes) {
+    bytes = sequence_length(str, pos);
+    switch (bytes) {
+    case 1:
+        return static_cast<unsigned char>(str[pos]);
+    case 2:
+        return ((str[pos] & 31) << 6) | (str[pos + 1] & 63);
+    case 3:
+        return ((str[pos] & 15) << 12) | ((str[pos + 1] & 63) << 6) |
                (str[pos + 2] & 63);
-    } else if ((c >> 3) == 0b11110 && pos + 3 < str.size()) {
-        bytes = 4;
-        return ((c & 7) << 18) | ((str[pos + 1] & 63) << 12) |
+    case 4:
+        return ((str[pos] & 7) << 18) | ((str[pos + 1] & 63) << 12) |
                ((str[pos + 2] & 63) << 6) | (str[pos + 3] & 63);
+    default:
+        return 0;
     }
-
-    bytes = 0;
-    return 0;
 }
 
 std::string encode_utf8(char32_t c) {
@@ -77,16 +104,170 @@ std::string encode_utf8(char32_t c) {
     return out;
 }
 
-std::size_t utf_length(std::string const &s) {
-    std::size_t len = 0;
-    for (std::size_t i = 0; i < s.length();) {
-        std::size_t b;
-        decode_utf(s, i, b);
-        if (!b) {
-            throw std::runtime_error("UTF decoding failed");
+// Whole blocks are validated a vector at a time, each against the three
+// bytes before it, which is as far back as a sequence reaches. Every byte
+// gets the rules sequence_length checks: it is a continuation exactly when
+// one of the three bytes before it leads a sequence long enough to cover it,
+// it is none of the bytes that never appear, and after E0, ED, F0 and F4 it
+// is in the narrower range those allow. The result is a mask of the bytes
+// breaking a rule, which the caller only tests for being empty.
+#if defined(__AVX2__)
+static unsigned invalid_bytes(__m256i prev, __m256i cur) {
+    auto at_least = [](__m256i v, unsigned char c) {
+        return _mm256_cmpeq_epi8(
+            _mm256_max_epu8(v, _mm256_set1_epi8(static_cast<char>(c))), v);
+    };
+    auto at_most = [](__m256i v, unsigned char c) {
+        return _mm256_cmpeq_epi8(
+            _mm256_min_epu8(v, _mm256_set1_epi8(static_cast<char>(c))), v);
+    };
+    auto is = [](__m256i v, unsigned char c) {
+        return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(c)));
+    };
+    // The bytes one, two and three places before each byte of cur
+    __m256i joined = _mm256_permute2x128_si256(prev, cur, 0x21);
+    __m256i back1 = _mm256_alignr_epi8(cur, joined, 15);
+    __m256i back2 = _mm256_alignr_epi8(cur, joined, 14);
+    __m256i back3 = _mm256_alignr_epi8(cur, joined, 13);
+
+    __m256i cont = _mm256_and_si256(at_least(cur, 0x80), at_most(cur, 0xBF));
+    __m256i needed = _mm256_or_si256(
+        _mm256_or_si256(at_least(back1, 0xC2), at_least(back2, 0xE0)),
+        at_least(back3, 0xF0));
+    __m256i bad = _mm256_xor_si256(cont, needed);
+    bad = _mm256_or_si256(
+        bad, _mm256_and_si256(at_least(cur, 0xC0), at_most(cur, 0xC1)));
+    bad = _mm256_or_si256(bad, at_least(cur, 0xF5));
+    bad = _mm256_or_si256(
+        bad, _mm256_and_si256(is(back1, 0xE0), at_most(cur, 0x9F)));
+    bad = _mm256_or_si256(
+        bad, _mm256_and_si256(is(back1, 0xED), at_least(cur, 0xA0)));
+    bad = _mm256_or_si256(
+        bad, _mm256_and_si256(is(back1, 0xF0), at_most(cur, 0x8F)));
+    bad = _mm256_or_si256(
+        bad, _mm256_and_si256(is(back1, 0xF4), at_least(cur, 0x90)));
+    return _mm256_movemask_epi8(bad);
+}
+#endif
+
+#if defined(__SSE2__)
+static unsigned invalid_bytes(__m128i prev, __m128i cur) {
+    auto at_least = [](__m128i v, unsigned char c) {
+        return _mm_cmpeq_epi8(
+            _mm_max_epu8(v, _mm_set1_epi8(static_cast<char>(c))), v);
+    };
+    auto at_most = [](__m128i v, unsigned char c) {
+        return _mm_cmpeq_epi8(
+            _mm_min_epu8(v, _mm_set1_epi8(static_cast<char>(c))), v);
+    };
+    auto is = [](__m128i v, unsigned char c) {
+        return _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(c)));
+    };
+    __m128i back1 =
+        _mm_or_si128(_mm_slli_si128(cur, 1), _mm_srli_si128(prev, 15));
+    __m128i back2 =
+        _mm_or_si128(_mm_slli_si128(cur, 2), _mm_srli_si128(prev, 14));
+    __m128i back3 =
+        _mm_or_si128(_mm_slli_si128(cur, 3), _mm_srli_si128(prev, 13));
+
+    __m128i cont = _mm_and_si128(at_least(cur, 0x80), at_most(cur, 0xBF));
+    __m128i needed = _mm_or_si128(
+        _mm_or_si128(at_least(back1, 0xC2), at_least(back2, 0xE0)),
+        at_least(back3, 0xF0));
+    __m128i bad = _mm_xor_si128(cont, needed);
+    bad = _mm_or_si128(bad,
+                       _mm_and_si128(at_least(cur, 0xC0), at_most(cur, 0xC1)));
+    bad = _mm_or_si128(bad, at_least(cur, 0xF5));
+    bad = _mm_or_si128(bad,
+                       _mm_and_si128(is(back1, 0xE0), at_most(cur, 0x9F)));
+    bad = _mm_or_si128(bad,
+                       _mm_and_si128(is(back1, 0xED), at_least(cur, 0xA0)));
+    bad = _mm_or_si128(bad,
+                       _mm_and_si128(is(back1, 0xF0), at_most(cur, 0x8F)));
+    bad = _mm_or_si128(bad,
+                       _mm_and_si128(is(back1, 0xF4), at_least(cur, 0x90)));
+    return _mm_movemask_epi8(bad);
+}
+#endif
+
+std::size_t utf_invalid_at(std::string_view const s) {
+    std::size_t i = 0;
+    // Stops at the first block with an invalid byte. A block of ASCII after
+    // another can't have one, so only the top bits are looked at then.
+#if defined(__AVX2__)
+    __m256i prev = _mm256_setzero_si256();
+    for (unsigned prev_high = 0; i + 32 <= s.size(); i += 32) {
+        __m256i cur =
+            _mm256_loadu_si256(reinterpret_cast<__m256i const *>(s.data() + i));
+        unsigned high = _mm256_movemask_epi8(cur);
+        if ((high | prev_high) && invalid_bytes(prev, cur))
+            break;
+        prev = cur;
+        prev_high = high;
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i last = i ? _mm_loadu_si128(reinterpret_cast<__m128i const *>(
+                           s.data() + i - 16))
+                     : _mm_setzero_si128();
+    for (unsigned last_high = _mm_movemask_epi8(last); i + 16 <= s.size();
+         i += 16) {
+        __m128i cur =
+            _mm_loadu_si128(reinterpret_cast<__m128i const *>(s.data() + i));
+        unsigned high = _mm_movemask_epi8(cur);
+        if ((high | last_high) && invalid_bytes(last, cur))
+            break;
+        last = cur;
+        last_high = high;
+    }
+#endif
+    // The rest is scanned from the start of the sequence running into it,
+    // which the blocks before only checked up to i
+    if (i > 0 && static_cast<unsigned char>(s[i - 1]) >= 0x80) {
+        --i;
+        for (int k = 0; k < 3 && i > 0 &&
+                        (static_cast<unsigned char>(s[i]) & 0xC0) == 0x80;
+             ++k) {
+            --i;
         }
+    }
+    while (i < s.size()) {
+        if (static_cast<unsigned char>(s[i]) < 0x80) {
+            ++i;
+            continue;
+        }
+        std::size_t b = sequence_length(s, i);
+        if (!b)
+            return i;
         i += b;
-        ++len;
+    }
+    return std::string_view::npos;
+}
+
+std::size_t utf_length(std::string_view const s) {
+    // Every code point has exactly one byte outside 0x80..0xBF
+    std::size_t len = 0;
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    for (__m256i cont = _mm256_set1_epi8(static_cast<char>(0xBF));
+         i + 32 <= s.size(); i += 32) {
+        __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<__m256i const *>(s.data() + i));
+        len += std::popcount(static_cast<unsigned>(
+            _mm256_movemask_epi8(_mm256_cmpgt_epi8(v, cont))));
+    }
+#endif
+#if defined(__SSE2__)
+    for (__m128i cont = _mm_set1_epi8(static_cast<char>(0xBF));
+         i + 16 <= s.size(); i += 16) {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<__m128i const *>(s.data() + i));
+        len += std::popcount(static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_cmpgt_epi8(v, cont))));
+    }
+#endif
+    for (; i < s.size(); ++i) {
+        len += static_cast<signed char>(s[i]) > static_cast<signed char>(0xBF);
     }
     return len;
 }
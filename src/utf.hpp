@@ -5,9 +5,16 @@
 
 bool is_space(char32_t c);
 
+// Decodes the code point at pos, setting bytes to 0 on an invalid sequence
 char32_t decode_utf(std::string_view const str, std::size_t pos,
                     std::size_t &bytes);
 
 std::string encode_utf8(char32_t c);
 
-std::size_t utf_length(std::string const &s);
+// Offset of the first byte that does not start a well-formed UTF-8
+// sequence, or npos. Overlong forms, surrogates and code points past
+// U+10FFFF are rejected.
+std::size_t utf_invalid_at(std::string_view const s);
+
+// Code points in s, which has to be valid UTF-8
+std::size_t utf_length(std::string_view const s);
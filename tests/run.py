@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+# Runs every program through the C backend and compares what each other
+# backend prints against it. Programs that stop on a runtime error print it
+# and exit 1, so only the output is compared.
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+
+def run(cmd, cwd):
+    proc = subprocess.run(cmd, cwd=cwd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    return proc.stdout.decode()
+
+
+def built(charta, src, cwd, *flags):
+    out = run([charta, src, *flags], cwd)
+    binary = Path(cwd) / ("out_" + Path(src).stem)
+    if not binary.exists():
+        return out
+    output = run([binary], cwd)
+    binary.unlink()
+    return output
+
+
+def cache_hit(charta, src, cwd):
+    # The first build saves the IR, so the second starts from the cache
+    built(charta, src, cwd, "-cache")
+    cache = Path(str(src) + ".chir")
+    if not cache.exists():
+        return "no IR cache was written\n"
+    saved = cache.stat().st_mtime_ns
+    output = built(charta, src, cwd, "-cache")
+    if cache.stat().st_mtime_ns != saved:
+        return "the IR cache was written again instead of read\n"
+    return output
+
+
+BACKENDS = {
+    "jit": lambda charta, src, cwd: run([charta, src, "-jit"], cwd),
+    "llvm": lambda charta, src, cwd: built(charta, src, cwd, "-llvm"),
+    "asm": lambda charta, src, cwd: built(charta, src, cwd, "-asm"),
+    "cache": cache_hit,
+}
+
+
+def main():
+    if len(sys.argv) < 3:
+        print(f"usage: {sys.argv[0]} <charta> <source>...", file=sys.stderr)
+        sys.exit(1)
+
+    charta = str(Path(sys.argv[1]).resolve())
+    failed = 0
+    for arg in sys.argv[2:]:
+        with tempfile.TemporaryDirectory() as cwd:
+            # Copied so nothing is written next to the checked-in program
+            src = Path(cwd) / Path(arg).name
+            src.write_bytes(Path(arg).read_bytes())
+            expected = built(charta, src, cwd)
+            for name, backend in BACKENDS.items():
+                got = backend(charta, src, cwd)
+                if got != expected:
+                    failed += 1
+                    print(f"FAIL {arg} ({name})")
+                    print(f"--- c\n{expected}--- {name}\n{got}", end="")
+                else:
+                    print(f"ok   {arg} ({name})")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()